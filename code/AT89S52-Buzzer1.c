@@ -4,8 +4,62 @@
  * Adapted for SDCC compilation
  */
 
-#include <8051.h>
 #include <stdint.h>
+#include "hal.h"
+#include "protocol.h"
+#include "board.h"
+
+/*----- Build Options -----*/
+#ifndef UART_ENABLE
+#define UART_ENABLE BOARD_UART     // Serial control link on RXD/TXD, needs BOARD_BRIDGE
+#endif
+#ifndef USER_TABLE_IN_XRAM
+#define USER_TABLE_IN_XRAM 1       // Uploaded table in external RAM
+#endif
+#ifndef EEPROM_ENABLE
+#define EEPROM_ENABLE 1            // Settings journal in a 24Cxx on P1.6/P1.7
+#endif
+#ifndef POWER_SAVE_ENABLE
+#define POWER_SAVE_ENABLE 1        // IDLE while off, POWER-DOWN after POWER_DOWN_DELAY
+#endif
+#ifndef SCHEDULE_ENABLE
+#define SCHEDULE_ENABLE 1          // Auto-off timeout and on/off duty schedule
+#endif
+#ifndef WATCHDOG_ENABLE
+#define WATCHDOG_ENABLE 1          // Hardware watchdog, warm restart keeps the running state
+#endif
+#ifndef RANGING_ENABLE
+#define RANGING_ENABLE 1           // Echo ranging pattern, Timer 2 capture on T2EX (P1.1)
+#endif
+#ifndef CALIBRATE_ENABLE
+#define CALIBRATE_ENABLE 1         // Frequency self-calibration, BUZZER looped back to T2 (P1.0)
+#endif
+#ifndef CALIBRATE_AT_BOOT
+#define CALIBRATE_AT_BOOT 0        // Calibrate after every cold start (needs the loopback wire)
+#endif
+#ifndef RESONANCE_ENABLE
+#define RESONANCE_ENABLE 1         // Resonance tracking pattern, level from a PCF8591 on the I2C bus
+#endif
+#define I2C_ENABLE (EEPROM_ENABLE || RESONANCE_ENABLE)
+#ifndef RANGE_SIM_ECHO_US
+#define RANGE_SIM_ECHO_US 0        // Simulator builds: fake an echo this many us after each ping
+#endif
+
+// Buffers and tables that are not touched on every loop pass go to external
+// RAM when it is fitted, leaving internal RAM to the stack (--stack-auto).
+// The linker places them with userTable from --xram-loc up.
+#if USER_TABLE_IN_XRAM
+#define BULK_RAM __xdata
+#else
+#define BULK_RAM __idata
+#endif
+
+#if UART_ENABLE && !BOARD_UART
+#error "This BOARD has the buzzer on RXD/TXD, build with UART_ENABLE=0"
+#endif
+#if UART_ENABLE && (T1_BAUD(PROTO_BAUD) * 100 < PROTO_BAUD * 98 || T1_BAUD(PROTO_BAUD) * 100 > PROTO_BAUD * 102)
+#error "No Timer 1 reload within 2% of PROTO_BAUD on this crystal"
+#endif
 
 /*----- Hardware Connections -----*/
 // Status LEDs (active low)
@@ -29,9 +83,26 @@ __sbit __at (0xA0 + 4) WALK_LED;     // red (P2.4) - Note: Same as PULSE_LED
 
 
 
-// Buzzer outputs
-__sbit __at (0xB0 + 0) BUZZER;      // P3.0 (normal)
-__sbit __at (0xB0 + 1) BUZZER_COMP; // P3.1 (complement)
+// Buzzer outputs, from the BOARD profile in board.h
+BOARD_SBIT(BUZZER, BUZZER_PORT, BUZZER_BIT);                // Normal
+BOARD_SBIT(BUZZER_COMP, BUZZER_COMP_PORT, BUZZER_COMP_BIT); // Complement
+
+#if I2C_ENABLE
+// I2C to the settings EEPROM and the level ADC (quasi-bidirectional pins act
+// as open drain)
+__sbit __at (0x90 + 6) I2C_SCL;     // P1.6
+__sbit __at (0x90 + 7) I2C_SDA;     // P1.7
+#endif
+
+#if WATCHDOG_ENABLE
+// AT89S52 watchdog, not in 8051.h
+__sfr __at (0xA6) WDTRST;
+#define PCON_POF 0x10              // Set by power-up only, not by other resets
+#endif
+
+// Echo ranging: the ultrasonic receiver comparator drives T2EX (P1.1, the
+// Timer 2 capture input from 8052.h) low on an echo
+// Self-calibration: a wire from BUZZER to T2 (P1.0, the Timer 2 count input)
 
 //  buttons
 __sbit __at (0xB0 + 2) BTN_POWER;    // Power button (P3.2)
@@ -40,76 +111,628 @@ __sbit __at (0xB0 + 4) BTN_SPEED;    // Speed button (P3.4)
 __sbit __at (0xB0 + 5) BTN_RANGE;    // Range button (P3.5)
 
 /*----- System State -----*/
+#define NUM_PATTERNS 16             // 0-10 built in, 11 = hopping, 12 = uploaded table, 13 = bursts,
+                                    // 14 = echo ranging, 15 = resonance tracking
+#define HOP_PATTERN  PROTO_HOP_PATTERN
+#define USER_PATTERN PROTO_USER_PATTERN
+#define BURST_PATTERN PROTO_BURST_PATTERN
+#define RANGE_PATTERN PROTO_RANGE_PATTERN
+#define RESO_PATTERN  PROTO_RESO_PATTERN
+#define NUM_SPEEDS   5
+#define PATTERN_PULSE     4         // Gated patterns, see envelope_reset()
+                                    // (BURST_PATTERN and RANGE_PATTERN are gated as well)
+#define PATTERN_HEARTBEAT 7
+
 __bit isActive = 0;                // Power state
 __bit currentRange = 0;            // 0=5-10kHz, 1=18-27kHz
 uint8_t currentPattern = 0;        // Current pattern (0-10)
 uint8_t currentSpeed = 0;          // Speed setting (0-4)
 __bit sweepDirection = 0;          // For zigzag pattern
+__bit dutyResting = 0;             // Schedule off phase: outputs parked, no tone
+
+/*----- Timebase -----*/
+// Timer 0 adds the reload to the count it already has, so interrupt latency
+// does not stretch the tick. One timer count is 12 clocks, 1us at 12MHz
+// (T0_COUNTS_PER_MS comes from board.h). The clock stops in POWER-DOWN, so
+// uptime is running time.
+#define T0_RELOAD        (65536 - T0_COUNTS_PER_MS)
+#define T0_STOP_COUNTS   12        // Counts lost while the ISR holds TR0 low
+
+volatile uint8_t tickCount = 0;    // Free-running 1ms tick, low byte of uptimeMs
+volatile uint32_t uptimeMs = 0;    // ms since reset; read with uptime_ms()
+
+/*----- Event Queue -----*/
+// Single-producer/single-consumer ring from the ISRs to the main loop. All
+// producers run at the same (low) interrupt priority and cannot preempt each
+// other, so together they form the single producer. evHead is written only
+// by event_post() and evTail only by dispatch_events(); both are single
+// bytes, so each update is one atomic MOV and no interrupt masking is needed.
+#define EVT_QUEUE_SIZE 8           // Power of two
+
+#define EVT_BUTTON     1           // data = button id | BTN_EVT_RELEASE
+#define EVT_UART_RX    2           // RX ring went from empty to non-empty
+
+__idata uint8_t evType[EVT_QUEUE_SIZE];
+__idata uint8_t evData[EVT_QUEUE_SIZE];
+__idata uint8_t evTick[EVT_QUEUE_SIZE];   // tickCount when the event happened
+volatile uint8_t evHead = 0;
+volatile uint8_t evTail = 0;
+volatile uint8_t evOverflows = 0;         // Events dropped on a full ring
+
+/*----- Button Events -----*/
+// BTN_POWER/BTN_PATTERN sit on INT0/INT1: the falling edge is timestamped by
+// the external interrupt, Timer0_ISR verifies it after BTN_DEBOUNCE_MS and
+// re-arms the interrupt once the button has been released for as long.
+// BTN_SPEED/BTN_RANGE have no interrupt pin and are scanned by TASK_BUTTONS.
+#define BTN_ID_POWER    0
+#define BTN_ID_PATTERN  1
+#define BTN_ID_SPEED    2
+#define BTN_ID_RANGE    3
+#define NUM_BUTTONS     4
+#define BTN_EVT_RELEASE 0x80       // Event data = button id | BTN_EVT_RELEASE
+#define BTN_DEBOUNCE_MS 20
+#define BTN_SCAN_MS     5          // TASK_BUTTONS period
+
+#define BTN_IDLE   0               // Released (edge interrupt armed)
+#define BTN_VERIFY 1               // Edge seen, waiting to confirm the press
+#define BTN_HELD   2               // Press queued, waiting for a clean release
+
+__idata uint8_t btnPhase[NUM_BUTTONS] = {BTN_IDLE, BTN_IDLE, BTN_IDLE, BTN_IDLE};
+__idata uint8_t btnTimer[NUM_BUTTONS];
+__idata uint8_t btnEdgeTick[2];    // tickCount at the INT0/INT1 falling edge
+
+/*----- Gestures -----*/
+// Click: POWER acts on press, the others on release. Long press (PATTERN,
+// SPEED) steps backwards. Double click on PATTERN recalls the next favorite.
+// SPEED+RANGE together open/close the settings menu.
+#define GESTURE_LONG_MS   600
+#define GESTURE_DOUBLE_MS 250
+#define CHORD_MASK        ((1 << BTN_ID_SPEED) | (1 << BTN_ID_RANGE))
+#define NUM_FAVORITES     3
+
+// Settings menu, the item is shown on the pattern LEDs. PATTERN selects the
+// item, SPEED applies it, POWER or the chord leaves the menu.
+#define MENU_FAVORITE     0        // Items 0..NUM_FAVORITES-1 store a favorite
+#define MENU_AUTO_OFF     NUM_FAVORITES
+#define MENU_DUTY         (NUM_FAVORITES + 1)
+#if SCHEDULE_ENABLE
+#define MENU_ITEMS        (NUM_FAVORITES + 2)
+#else
+#define MENU_ITEMS        NUM_FAVORITES
+#endif
+
+// Favorites: {pattern, speed | range << 7}, kept in RAM only
+BULK_RAM uint8_t favorites[NUM_FAVORITES][2] = {{0, 0}, {8, 2}, {2, 0x84}};
+uint8_t favoriteIndex = 0;
+
+BULK_RAM uint16_t pressTime[NUM_BUTTONS];
+uint8_t heldMask = 0;              // Buttons currently down
+uint8_t consumedMask = 0;          // Held buttons whose release is ignored
+uint16_t clickTime = 0;            // First PATTERN click of a possible double
+__bit clickPending = 0;
+__bit menuActive = 0;
+uint8_t menuItem = 0;
+
+/*----- Task Scheduler -----*/
+// Periodic work runs from a static table on the 1ms tick. scheduler_run()
+// starts at most one due task per main-loop pass, so a pass never costs more
+// than one task plus one tone step, however much falls due at once. Lower
+// index wins when several tasks are due, and the loop does not idle until
+// none is left.
+#define TASK_PATTERN   0           // Pattern step
+#define TASK_BUTTONS   1           // Polled button scan
+#define TASK_GESTURES  2           // Double-click and long-press timeouts
+#define TASK_LEDS      3           // SPEED_LED blink
+#define TASK_SETTINGS  4           // Deferred EEPROM save, one byte per run
+#define TASK_SCHEDULE  5           // Auto-off and duty schedule
+#define TASK_TELEMETRY 6           // Period set by PROTO_CMD_TELEMETRY
+#define TASK_WATCHDOG  7           // Last, so starved tasks starve the watchdog too
+#define NUM_TASKS      8
+
+#define PATTERN_STEP_MS 1          // Patterns advance at a fixed rate, not per loop pass
+#define LED_BLINK_MS    100        // 5Hz blink
+#if WATCHDOG_ENABLE
+// Watchdog fires after 16384 machine cycles (~16ms at 12MHz), fed 4 times as often
+#define WDT_FEED_MS     (16384UL * 12 / 4 / FOSC_KHZ)
+#else
+#define WDT_FEED_MS     0
+#endif
+
+uint16_t nowMs = 0;                // Low half of uptime, sampled by clock_update()
+uint8_t schedTick = 0;             // tickCount once no task was left due
+
+// ms between runs, 0 = disabled
+BULK_RAM uint16_t taskPeriod[NUM_TASKS] = {
+    PATTERN_STEP_MS, BTN_SCAN_MS, 10, LED_BLINK_MS, 10, 1000, 0, WDT_FEED_MS
+};
+BULK_RAM uint16_t taskDue[NUM_TASKS];   // nowMs of the next run
 
 /*----- Sound Parameters -----*/
 uint16_t currentFreqDelay;         // Current delay value
+__bit toneNarrow = 0;              // Delays fit in a byte: main() runs generate_tone8()
 
-// Frequency range parameters [min, max, initial]
-const uint16_t rangeParams[2][3] = {
-    {25, 50, 37},  // 5-10kHz range
-    {9, 18, 13}    // 18-27kHz range
+// Frequency range parameters [min, max, initial], replaced by cal_finish().
+// A warm restart keeps the calibrated values.
+BULK_RAM uint16_t rangeParams[2][3] = {
+    {FOSC_SCALE(25), FOSC_SCALE(50), FOSC_SCALE(37)},  // 5-10kHz range
+    {FOSC_SCALE(9), FOSC_SCALE(18), FOSC_SCALE(13)}    // 18-27kHz range
 };
 
 // Speed multipliers
 const uint8_t speedSteps[5] = {1, 2, 3, 5, 8};
 
+// Second voice on BUZZER_COMP, PROTO_VOICE2_* mode
+uint8_t voice2Mode = PROTO_VOICE2_OFF;
+uint16_t voice2Value = 0;          // Carrier delay, or detune offset as int16_t
+
+/*----- Gate Envelope -----*/
+// Sits between the patterns and generate_tone(). The piezo has three drive
+// levels: silent (both lines parked low), half (BUZZER alone against a parked
+// BUZZER_COMP) and full (bridge). An envelope ramps through half on attack and
+// release and holds at full. While the gate is shut the main loop makes no
+// toggles at all and the CPU idles.
+#define GATE_OFF    0
+#define GATE_HALF   1
+#define GATE_FULL   2
+
+#define ENV_OPEN    0              // No envelope, gate held at GATE_FULL
+#define ENV_ATTACK  1
+#define ENV_HOLD    2
+#define ENV_RELEASE 3
+#define ENV_CLOSED  4              // Waiting for the next envelope_trigger()
+
+#define ENV_RAMP_MS 5              // Attack and release used by the built-in patterns
+
+// What generate_tone() does with BUZZER_COMP
+#define COMP_PARKED 0
+#define COMP_MIRROR 1              // Inverse of BUZZER
+#define COMP_VOICE2 2              // Second voice
+
+uint8_t gateLevel = GATE_FULL;
+uint8_t compMode = COMP_MIRROR;
+uint8_t envPhase = ENV_OPEN;
+uint8_t envLeft = 0;               // ms left in the current phase
+uint8_t envHold = 0;
+uint8_t envRelease = 0;
+__bit patternStart = 0;            // update_sweep() restarts its counters
+
+/*----- Tone Bursts -----*/
+// BURST_PATTERN: generate_tone() counts the toggles of a burst and shuts the
+// gate after exactly burstCycles carrier periods; the gap is timed by the tick.
+#define BURST_CYCLES 8
+#define BURST_DELAY  FOSC_SCALE(9) // Top of the 18-27kHz range
+#define BURST_GAP_MS 50
+
+uint16_t toneCounter = 0;          // generate_tone() position within a half period
+uint8_t toneCounter8 = 0;          // The same for generate_tone8()
+uint8_t burstCycles = BURST_CYCLES;
+uint16_t burstDelay = BURST_DELAY;
+uint16_t burstGap = BURST_GAP_MS;
+uint16_t burstToggles = 0;         // Left in the running burst, 0 = none
+
+/*----- Echo Ranging -----*/
+// RANGE_PATTERN: every RANGE_PERIOD_MS a short ping goes out and Timer 2
+// counts from its start; the first falling edge on T2EX after the blanking
+// time captures the flight time into RCAP2H/L. The result is read just
+// before the next ping. One Timer 2 count is 12 clocks, so the 16-bit
+// capture covers about 11m at 12MHz and 4m at 33MHz.
+#define RANGE_PERIOD_MS  50        // 20 pings per second
+#define RANGE_CYCLES     8
+#define RANGE_BLANK_US   1000      // Ignore the transmitter ringing into the receiver
+#define RANGE_SOUND_MM_PER_MS 343  // Speed of sound at about 20C
+#define US_TO_T2(us)     ((uint16_t)((uint32_t)(us) * FOSC_KHZ / 12000))
+#define T2CON_CAPTURE    0x0D      // CP/RL2 | EXEN2 | TR2
+
+#if RANGING_ENABLE
+volatile uint16_t rangeEcho = 0;   // Flight time of the last ping in Timer 2 counts, 0 = no echo yet
+uint16_t rangeMm = PROTO_RANGE_NONE;  // Distance from the previous ping
+#if RANGE_SIM_ECHO_US
+__bit rangeSimPending = 0;
+#endif
+#endif
+
+/*----- Self-Calibration -----*/
+// Timer 2 counts the looped-back BUZZER periods while the main loop plays
+// each delay value for CAL_GATE_MS, so the result includes whatever the
+// compiler made of generate_tone(). Per range, the first delay at or below
+// the top label becomes the minimum and the last one still reaching the
+// bottom label the maximum.
+#define CAL_FIRST_DELAY  4
+#define CAL_LAST_DELAY   FOSC_SCALE(63)
+#define CAL_GATE_MS      50        // 20Hz resolution, about 3s in total at 12MHz
+#define T2CON_COUNTER    0x06      // C/T2 | TR2: count falling edges on T2
+
+#if CALIBRATE_ENABLE
+// Nominal limits in Hz [bottom, top], as printed on the range LED
+const uint16_t rangeLabelHz[2][2] = {
+    {5000, 10000},
+    {18000, 27000}
+};
+
+__bit calActive = 0;               // Main loop plays calDelay regardless of power and gate
+uint8_t calDelay;
+uint8_t calGate;                   // ms into the current gate
+BULK_RAM uint8_t calLimit[2][2];    // [min, max] delay found so far, 0 = none
+#endif
+
+/*----- Resonance Tracking -----*/
+// RESO_PATTERN: sweeps the current range from low to high frequency, holding
+// each delay for RESO_SETTLE_MS before reading the drive level from channel
+// 0 of a PCF8591, and keeps the delay with the highest level. Every
+// RESO_TRACK_MS (at speed 0) it then tries one step either side and moves
+// to whichever of the three reads highest.
+#define ADC_DEV          0x90      // PCF8591 with A2..A0 tied low
+#define ADC_CHANNEL      0x00      // Single-ended AIN0, no auto-increment
+#define RESO_SETTLE_MS   10        // Transducer and peak detector settle time
+#define RESO_TRACK_MS    1000      // Between dithers, divided by speedSteps
+
+#define RESO_SWEEP  0
+#define RESO_DITHER 1              // Probing best - 1, best + 1, best
+#define RESO_LOCKED 2
+
+#if RESONANCE_ENABLE
+uint8_t resoPhase = RESO_SWEEP;
+uint8_t resoProbe = 0;             // Dither step, 0-2
+uint16_t resoTimer = 0;            // ms in the current step
+uint8_t resoBest = 0;              // Delay with the highest level so far
+uint8_t resoBestLevel = 0;
+uint8_t resoLevel = 0;             // Last reading, 0 also when no ADC answers
+BULK_RAM uint8_t resoProbeLevel[3];
+__bit resoRange = 0;               // Range the lock belongs to
+#endif
+
+/*----- Frequency Hopping -----*/
+// Every hop period the LFSR shifts in HOP_LFSR_STEPS fresh bits and its low
+// bits pick the next delay from hopSet. Each entry, and each pair of
+// consecutive entries, comes up about equally often.
+#define HOP_SET_SIZE    PROTO_HOP_SET_SIZE   // Power of two
+#define HOP_LFSR_STEPS  3                    // log2(HOP_SET_SIZE)
+#define HOP_LFSR_TAPS   0xB400               // x^16 + x^14 + x^13 + x^11 + 1
+#define HOP_PERIOD_MS   40                   // At speed 0, divided by speedSteps
+
+BULK_RAM uint8_t hopSet[HOP_SET_SIZE];        // Delay values
+uint8_t hopPeriod = HOP_PERIOD_MS;
+uint16_t hopLfsr = 0xACE1;                   // Never 0
+__bit hopCustom = 0;                         // hopSet came from the host, keep it across range changes
+
+/*----- Uploaded Pattern Table -----*/
+// Each point holds an absolute delay value for dwell ms, independent of range
+typedef struct {
+    uint16_t delay;
+    uint16_t dwell;
+} sweep_point_t;
+
+#if USER_TABLE_IN_XRAM
+#define USER_TABLE_MAX 64
+// Placed by the linker like the other XRAM data; an absolute address here
+// would overlap them whenever --xram-loc points at it
+__xdata sweep_point_t userTable[USER_TABLE_MAX];
+#else
+#define USER_TABLE_MAX 8
+__idata sweep_point_t userTable[USER_TABLE_MAX];
+#endif
+uint8_t userTableCount = 0;        // Points announced by TABLE_BEGIN
+uint8_t userIndex = 0;             // Point being played
+uint16_t userPointStart = 0;       // nowMs when the current point started
+__bit userTableValid = 0;          // Set once TABLE_COMMIT verified the CRC
+__bit userTableWide = 0;           // Some delay needs the 16-bit tone path
+
+
+/*----- Serial Link -----*/
+#if UART_ENABLE
+#define UART_RX_SIZE 16            // Ring sizes must be powers of two
+#define UART_TX_SIZE 32
+
+BULK_RAM uint8_t uartRxBuf[UART_RX_SIZE];
+BULK_RAM uint8_t uartTxBuf[UART_TX_SIZE];
+volatile uint8_t uartRxHead = 0;   // Written by Serial_ISR only
+volatile uint8_t uartRxTail = 0;   // Written by main loop only
+volatile uint8_t uartTxHead = 0;   // Written by main loop only
+volatile uint8_t uartTxTail = 0;   // Written by Serial_ISR only
+volatile uint8_t uartRxOverruns = 0;
+volatile __bit uartTxBusy = 0;
+
+uint8_t telemetryPeriod = 0;          // 10ms units, 0=off
+uint8_t telemetrySeq = 0;
+uint16_t loopCount = 0;               // Main loop iterations since last telemetry
+#endif
+
+/*----- Settings Journal -----*/
+#if EEPROM_ENABLE
+#define EEPROM_DEV          0xA0   // 24Cxx with A2..A0 tied low
+#define EEPROM_ADDR_BYTES   1      // 1 for 24C01/02, 2 for 24C32 and larger
+#define JOURNAL_BASE        0x00
+#define JOURNAL_SLOTS       64     // Power of two; 4-byte records never straddle a page
+#define SETTINGS_SAVE_DELAY 2000   // ms without changes before a record is written
+
+// Record: seq, pattern, flags (bit0 active, bit1 range, bits4-6 speed), crc8
+__bit eepromPresent = 0;
+__bit settingsDirty = 0;
+uint8_t journalSlot = 0;           // Next slot to write
+uint8_t journalSeq = 0;            // Sequence number for that slot
+uint8_t journalState = 0;          // Write state machine, 0 = idle
+uint16_t settingsChangedAt = 0;    // nowMs of the last setting change
+#endif
+
+/*----- Power Management -----*/
+#if POWER_SAVE_ENABLE
+#define POWER_DOWN_DELAY 5000      // ms off and quiet before stopping the oscillator
+
+volatile __bit cpuIdle = 0;        // Set while main() sits in IDLE
+volatile uint16_t idleTicks = 0;   // Timer 0 ticks that woke the CPU from IDLE
+uint32_t quietSince = 0;           // Uptime of the last user or host activity
+#endif
+
+/*----- Run Schedule -----*/
+#if SCHEDULE_ENABLE
+#define AUTO_OFF_SECONDS   0       // 0 = never switch off by itself
+#define DUTY_ON_SECONDS    0       // 0 = continuous tone, no rest phases
+#define DUTY_OFF_SECONDS   0
+
+uint16_t autoOffSeconds = AUTO_OFF_SECONDS;
+uint16_t dutyOnSeconds = DUTY_ON_SECONDS;
+uint16_t dutyOffSeconds = DUTY_OFF_SECONDS;
+uint16_t autoOffLeft = 0;          // Seconds until auto-off
+uint16_t phaseLeft = 0;            // Seconds left in the current on/off phase
+#endif
+
+/*----- Warm Restart -----*/
+#if WATCHDOG_ENABLE
+// A reset other than power-up leaves internal RAM alone. When POF is clear
+// and this block checks out, the startup code skips the RAM clear and the
+// variable initializers, and main() resumes the state kept here instead of
+// restoring from EEPROM.
+#define WARM_MAGIC 0x5A
+
+typedef struct {
+    uint8_t magic;
+    uint8_t pattern;
+    uint8_t speed;
+    uint8_t flags;                 // PROTO_FLAG_ACTIVE | PROTO_FLAG_RANGE
+    uint8_t restarts;              // Warm restarts since power-up
+    uint8_t crc;                   // crc8 over the bytes above
+} warm_block_t;
+
+__idata warm_block_t warmBlock;
+uint8_t warmStart = 0;             // Set by the startup code on a warm restart
+#endif
+
 /*----- Function Prototypes -----*/
-void delay_ms(uint16_t ms);
 void updateStatusLEDs(void);
-__bit checkButton_PWR(void);
-__bit checkButton_PAT(void);
-__bit checkButton_SPD(void);
-__bit checkButton_RNG(void);
+__bit button_tick(uint8_t id, __bit released);
+void button_sample(uint8_t id, __bit released);
+void event_post(uint8_t type, uint8_t data, uint8_t tick);
+void dispatch_events(void);
+uint32_t uptime_ms(void);
+void clock_update(void);
+void scheduler_run(void);
+void task_set_period(uint8_t id, uint16_t ms);
+void task_pattern(void);
+void task_buttons(void);
+void task_gestures(void);
+void task_leds(void);
+void task_settings(void);
+void task_schedule(void);
+void task_telemetry(void);
+void task_watchdog(void);
+void wdt_feed(void);
+#if WATCHDOG_ENABLE
+uint8_t warm_crc(void);
+void warm_save(void);
+void warm_resume(void);
+#endif
+void gesture_event(uint8_t event, uint8_t tick);
+void gesture_timeouts(void);
+void gesture_click(uint8_t id);
+void gesture_long(uint8_t id);
+void recall_favorite(void);
+void menu_apply(void);
+__bit pattern_valid(uint8_t pattern);
+uint8_t pattern_step(uint8_t pattern, __bit back);
+void burst_fire(uint8_t cycles, uint16_t delay);
+#if RANGING_ENABLE
+void range_ping(void);
+void range_stop(void);
+#if RANGE_SIM_ECHO_US
+void range_sim_echo(void);
+#endif
+#endif
+#if CALIBRATE_ENABLE
+void cal_start(void);
+void cal_gate_open(void);
+void cal_tick(void);
+void cal_finish(void);
+#endif
+#if RESONANCE_ENABLE
+__bit adc_read(void);
+void reso_start(void);
+void reso_tick(void);
+#endif
+void pattern_restart(void);
+uint8_t burst_config(const uint8_t *arg, uint8_t len);
 void handleButtons(void);
 void generate_tone(void);
+void generate_tone8(void);
+__bit tone_toggle(void);
+__bit tone_step(void);
+void tone_select(void);
+uint8_t voice2_set(uint8_t mode, uint16_t value);
+void hop_default_set(void);
+uint8_t hop_config(const uint8_t *arg, uint8_t len);
+void gate_set(uint8_t level);
+void gate_apply(void);
+void output_park(void);
+void envelope_reset(void);
+void envelope_trigger(uint8_t attack, uint8_t hold, uint8_t release);
+void envelope_enter(uint8_t phase);
+void envelope_tick(void);
 void update_sweep(void);
+__bit delay_step(int16_t step);
+void system_init(void);
 uint8_t simple_rand(void);
-
-/*----- Delay Function -----*/
-void delay_ms(uint16_t ms) {
-    uint16_t i, j;
-    for(i=0; i<ms; i++)
-        for(j=0; j<120; j++);  // ~1ms at 12MHz
-}
+void set_power(__bit on);
+void set_pattern(uint8_t pattern);
+void set_speed(uint8_t speed);
+void set_range(__bit range);
+void state_changed(void);
+void note_activity(void);
+uint8_t crc8_update(uint8_t crc, uint8_t b);
+#if I2C_ENABLE
+void i2c_start(void);
+void i2c_stop(void);
+__bit i2c_write(uint8_t b);
+uint8_t i2c_read(__bit ack);
+#endif
+#if EEPROM_ENABLE
+__bit eeprom_read(uint16_t addr, uint8_t *buf, uint8_t n);
+void settings_restore(void);
+void settings_changed(void);
+void settings_service(void);
+#endif
+#if UART_ENABLE
+void uart_init(void);
+void uart_putc(uint8_t c);
+void send_frame(uint8_t cmd, const uint8_t *payload, uint8_t len);
+void send_status(void);
+void send_telemetry(void);
+void handle_command(uint8_t cmd, const uint8_t *arg, uint8_t len);
+uint8_t table_command(uint8_t cmd, const uint8_t *arg, uint8_t len);
+uint16_t table_crc16(void);
+void serial_poll(void);
+#endif
+#if POWER_SAVE_ENABLE
+void power_save(void);
+void power_down(void);
+void cpu_idle(void);
+#endif
+#if SCHEDULE_ENABLE
+void schedule_restart(void);
+void schedule_second(void);
+#endif
+uint8_t status_flags(void);
 
 /*----- Timer 0 ISR -----*/
 void Timer0_ISR() __interrupt(1) {
-    static uint16_t msCount = 0;
-    TH0 = 0xFC; TL0 = 0x66;  // Reload for 1ms
-    
-    if(isActive) {
-        if(++msCount >= 100) {  // 5Hz blink
-            SPEED_LED = !SPEED_LED;
-            msCount = 0;
+    uint16_t count;
+
+    TR0 = 0;                  // Reload for 1ms, keeping the counts since overflow
+    count = (((uint16_t)TH0 << 8) | TL0) + (uint16_t)(T0_RELOAD + T0_STOP_COUNTS);
+    TL0 = (uint8_t)count;
+    TH0 = (uint8_t)(count >> 8);
+    TR0 = 1;
+    tickCount++;
+    uptimeMs++;
+#if POWER_SAVE_ENABLE
+    if(cpuIdle) idleTicks++;  // This tick ended an IDLE period
+#endif
+
+    // Debounce the interrupt-driven buttons
+    if(btnPhase[BTN_ID_POWER] && button_tick(BTN_ID_POWER, BTN_POWER)) {
+        IE0 = 0;              // Drop edges latched while bouncing
+        EX0 = 1;
+    }
+    if(btnPhase[BTN_ID_PATTERN] && button_tick(BTN_ID_PATTERN, BTN_PATTERN)) {
+        IE1 = 0;
+        EX1 = 1;
+    }
+}
+
+#if RANGING_ENABLE
+/*----- Timer 2 ISR -----*/
+// Capture mode: EXF2 is an edge on T2EX, TF2 means no echo within 65ms
+void Timer2_ISR() __interrupt(5) {
+    uint16_t capture;
+
+    if(EXF2) {
+        EXF2 = 0;
+        capture = ((uint16_t)RCAP2H << 8) | RCAP2L;
+        if(capture >= US_TO_T2(RANGE_BLANK_US)) {
+            rangeEcho = capture;
+            T2CON = 0;            // First echo only, stop until the next ping
         }
-    } else {
-        SPEED_LED = 1;  // Turn off (active low)
     }
+    if(TF2) T2CON = 0;
 }
+#endif
+
+/*----- Timebase -----*/
+// Safe with interrupts off: EA comes back as the caller had it
+uint32_t uptime_ms() {
+    uint32_t ms;
+    __bit ea = EA;
+
+    EA = 0;                       // 32-bit value shared with Timer0_ISR
+    ms = uptimeMs;
+    EA = ea;
+    return ms;
+}
+
+/*----- External Interrupt ISRs -----*/
+// Falling edge on BTN_POWER; also the wake-up source from POWER-DOWN
+void Ext0_ISR() __interrupt(0) {
+    EX0 = 0;  // Ignore bounce until Timer0_ISR re-arms
+    btnEdgeTick[BTN_ID_POWER] = tickCount;
+    btnTimer[BTN_ID_POWER] = BTN_DEBOUNCE_MS;
+    btnPhase[BTN_ID_POWER] = BTN_VERIFY;
+}
+
+// Falling edge on BTN_PATTERN
+void Ext1_ISR() __interrupt(2) {
+    EX1 = 0;
+    btnEdgeTick[BTN_ID_PATTERN] = tickCount;
+    btnTimer[BTN_ID_PATTERN] = BTN_DEBOUNCE_MS;
+    btnPhase[BTN_ID_PATTERN] = BTN_VERIFY;
+}
+
+/*----- Serial ISR -----*/
+#if UART_ENABLE
+void Serial_ISR() __interrupt(4) {
+    uint8_t next;
+    if(RI) {
+        RI = 0;
+        next = (uartRxHead + 1) & (UART_RX_SIZE - 1);
+        if(next != uartRxTail) {
+            // One event per burst: serial_poll() drains until the ring is empty
+            if(uartRxHead == uartRxTail) event_post(EVT_UART_RX, 0, tickCount);
+            uartRxBuf[uartRxHead] = SBUF;
+            uartRxHead = next;
+        } else {
+            if(uartRxOverruns != 0xFF) uartRxOverruns++;  // Byte dropped, parser resyncs on CRC
+        }
+    }
+    if(TI) {
+        TI = 0;
+        if(uartTxTail != uartTxHead) {
+            SBUF = uartTxBuf[uartTxTail];
+            uartTxTail = (uartTxTail + 1) & (UART_TX_SIZE - 1);
+        } else {
+            uartTxBusy = 0;
+        }
+    }
+}
+#endif
 
 /*----- Update Status LEDs -----*/
 void updateStatusLEDs() {
+    uint8_t shown;
+    
     // Power and range indicators
     // Note: POWER_LED not defined in new pin config, using SPEED_LED and RANGE_LED
     RANGE_LED = !currentRange;
     
-    // Pattern indicators (only one active at a time)
-    UP_LED      = (currentPattern != 0);
-    DOWN_LED    = (currentPattern != 1);
-    ZIGZAG_LED  = (currentPattern != 2);
-    RAND_LED    = (currentPattern != 3);
-    PULSE_LED   = (currentPattern != 4);
-    STEP_LED    = (currentPattern != 5);
-    TRIANGLE_LED= (currentPattern != 6);
-    HEART_LED   = (currentPattern != 7);
-    SIREN_LED   = (currentPattern != 8);
-    CHIRP_LED   = (currentPattern != 9);
-    WALK_LED    = (currentPattern != 10);
+    // Pattern indicators (only one active at a time), menu item in the menu
+    shown = menuActive ? menuItem : currentPattern;
+    UP_LED      = (shown != 0);
+    DOWN_LED    = (shown != 1);
+    ZIGZAG_LED  = (shown != 2);
+    RAND_LED    = (shown != 3);
+    PULSE_LED   = (shown != 4);
+    STEP_LED    = (shown != 5);
+    TRIANGLE_LED= (shown != 6);
+    HEART_LED   = (shown != 7);
+    SIREN_LED   = (shown != 8);
+    CHIRP_LED   = (shown != 9);
+    WALK_LED    = (shown != 10);
 }
 
 /*----- Random Number Generator -----*/
@@ -119,70 +742,1509 @@ uint8_t simple_rand() {
     return (uint8_t)(seed & 0xFF);
 }
 
-/*----- Button Check Functions -----*/
-__bit checkButton_PWR() {
-    static __bit lastState = 1;
-    __bit current = BTN_POWER;
-    if(current != lastState) {
-        delay_ms(20);  // Debounce delay
-        if(BTN_POWER == current) {
-            lastState = current;
-            return !current;  // Active low
+/*----- Event Queue -----*/
+// Producer side, ISR context only
+void event_post(uint8_t type, uint8_t data, uint8_t tick) {
+    uint8_t head = evHead;
+    uint8_t next = (head + 1) & (EVT_QUEUE_SIZE - 1);
+    if(next == evTail) {
+        if(evOverflows != 0xFF) evOverflows++;
+        return;
+    }
+    evType[head] = type;
+    evData[head] = data;
+    evTick[head] = tick;
+    evHead = next;            // Publish only after the slot is filled
+}
+
+// Consumer side, the only place the main loop reacts to ISRs
+void dispatch_events() {
+    uint8_t type, data, tick;
+
+    while(evTail != evHead) {
+        type = evType[evTail];
+        data = evData[evTail];
+        tick = evTick[evTail];
+        evTail = (evTail + 1) & (EVT_QUEUE_SIZE - 1);
+
+        switch(type) {
+            case EVT_BUTTON:
+                gesture_event(data, tick);
+                break;
+
+#if UART_ENABLE
+            case EVT_UART_RX:
+                serial_poll();
+                break;
+#endif
         }
     }
-    return 0;
 }
 
-__bit checkButton_PAT() {
-    static __bit lastState = 1;
-    __bit current = BTN_PATTERN;
-    if(current != lastState) {
-        delay_ms(20);
-        if(BTN_PATTERN == current) {
-            lastState = current;
-            return !current;
+/*----- Task Scheduler -----*/
+void (* const taskRun[NUM_TASKS])(void) = {
+    task_pattern, task_buttons, task_gestures, task_leds,
+    task_settings, task_schedule, task_telemetry, task_watchdog
+};
+
+void clock_update() {
+    nowMs = (uint16_t)uptime_ms();
+}
+
+// Runs the first due task and returns, leaving schedTick behind so the next
+// pass scans again; records the tick once nothing is due any more
+void scheduler_run() {
+    uint8_t i;
+
+    clock_update();
+    for(i=0; i<NUM_TASKS; i++) {
+        if(taskPeriod[i] && (int16_t)(nowMs - taskDue[i]) >= 0) {
+            taskDue[i] += taskPeriod[i];
+            if((int16_t)(nowMs - taskDue[i]) >= 0)
+                taskDue[i] = nowMs + taskPeriod[i];  // Fell behind, drop the missed runs
+            taskRun[i]();
+            return;
         }
     }
-    return 0;
+    schedTick = (uint8_t)nowMs;
+}
+
+void task_set_period(uint8_t id, uint16_t ms) {
+    taskPeriod[id] = ms;
+    taskDue[id] = nowMs + ms;
+}
+
+void task_pattern() {
+#if CALIBRATE_ENABLE
+    if(calActive) {
+        cal_tick();
+        return;
+    }
+#endif
+    if(isActive && !dutyResting) {
+        envelope_tick();
+        update_sweep();
+    }
+}
+
+void task_buttons() {
+    button_sample(BTN_ID_SPEED, BTN_SPEED);
+    button_sample(BTN_ID_RANGE, BTN_RANGE);
+}
+
+void task_gestures() {
+    gesture_timeouts();
+}
+
+void task_leds() {
+    if(isActive) SPEED_LED = !SPEED_LED;
+    else SPEED_LED = 1;           // Off (active low)
 }
 
-__bit checkButton_SPD() {
-    static __bit lastState = 1;
-    __bit current = BTN_SPEED;
-    if(current != lastState) {
-        delay_ms(20);
-        if(BTN_SPEED == current) {
-            lastState = current;
-            return !current;
+void task_settings() {
+#if EEPROM_ENABLE
+    if(eepromPresent && (settingsDirty || journalState)) settings_service();
+#endif
+}
+
+void task_schedule() {
+#if SCHEDULE_ENABLE
+    if(isActive) schedule_second();
+#endif
+}
+
+void task_telemetry() {
+#if UART_ENABLE
+    send_telemetry();
+#endif
+}
+
+void task_watchdog() {
+    wdt_feed();
+}
+
+/*----- Interrupt-Driven Buttons -----*/
+// One debounce step, called from Timer0_ISR while the button is not idle.
+// Returns 1 once the button is released and its edge interrupt may be re-armed.
+__bit button_tick(uint8_t id, __bit released) {
+    if(btnPhase[id] == BTN_VERIFY) {
+        if(--btnTimer[id]) return 0;
+        if(released) {                      // Too short, just noise
+            btnPhase[id] = BTN_IDLE;
+            return 1;
         }
+        event_post(EVT_BUTTON, id, btnEdgeTick[id]);
+        btnPhase[id] = BTN_HELD;
+        btnTimer[id] = BTN_DEBOUNCE_MS;
+        return 0;
+    }
+
+    // BTN_HELD: the release must stay high for the whole debounce time
+    if(!released) {
+        btnTimer[id] = BTN_DEBOUNCE_MS;
+    } else if(--btnTimer[id] == 0) {
+        event_post(EVT_BUTTON, id | BTN_EVT_RELEASE, tickCount - BTN_DEBOUNCE_MS);
+        btnPhase[id] = BTN_IDLE;
+        return 1;
     }
     return 0;
 }
 
-__bit checkButton_RNG() {
-    static __bit lastState = 1;
-    __bit current = BTN_RANGE;
-    if(current != lastState) {
-        delay_ms(20);
-        if(BTN_RANGE == current) {
-            lastState = current;
-            return !current;
+
+// Debounce for the polled buttons, run every BTN_SCAN_MS: a level change
+// must hold for BTN_DEBOUNCE_MS. btnPhase is BTN_HELD while the button is down.
+void button_sample(uint8_t id, __bit released) {
+    if(released == (btnPhase[id] != BTN_HELD)) {
+        btnTimer[id] = 0;                   // Level unchanged
+        return;
+    }
+    if(++btnTimer[id] < BTN_DEBOUNCE_MS / BTN_SCAN_MS) return;
+    btnTimer[id] = 0;
+    if(released) {
+        btnPhase[id] = BTN_IDLE;
+        gesture_event(id | BTN_EVT_RELEASE, tickCount - BTN_DEBOUNCE_MS);
+    } else {
+        btnPhase[id] = BTN_HELD;
+        gesture_event(id, tickCount - BTN_DEBOUNCE_MS);
+    }
+}
+
+/*----- Gesture Recognizer -----*/
+__bit pattern_valid(uint8_t pattern) {
+    // The uploaded table slot is skipped until a table is committed
+    if(pattern >= NUM_PATTERNS) return 0;
+#if !RANGING_ENABLE
+    if(pattern == RANGE_PATTERN) return 0;
+#endif
+#if !RESONANCE_ENABLE
+    if(pattern == RESO_PATTERN) return 0;
+#endif
+    return pattern != USER_PATTERN || userTableValid;
+}
+
+// Next (or previous) playable pattern, wrapping around
+uint8_t pattern_step(uint8_t pattern, __bit back) {
+    do {
+        if(back) pattern = pattern ? pattern - 1 : NUM_PATTERNS - 1;
+        else pattern = pattern + 1 < NUM_PATTERNS ? pattern + 1 : 0;
+    } while(!pattern_valid(pattern));
+    return pattern;
+}
+
+// One debounced press or release; never waits
+void gesture_event(uint8_t event, uint8_t tick) {
+    uint8_t id = event & ~BTN_EVT_RELEASE;
+    uint8_t mask = 1 << id;
+    uint16_t t;
+
+    clock_update();
+    t = nowMs - (uint8_t)((uint8_t)nowMs - tick);  // tickCount is the low byte of uptime
+
+    if(!(event & BTN_EVT_RELEASE)) {
+        heldMask |= mask;
+        pressTime[id] = t;
+        if((heldMask & CHORD_MASK) == CHORD_MASK) {
+            consumedMask |= CHORD_MASK;
+            clickPending = 0;
+            menuActive = !menuActive;
+            menuItem = 0;
+            updateStatusLEDs();
+        } else if(id == BTN_ID_POWER) {
+            consumedMask |= mask;       // Power reacts on press
+            gesture_click(id);
+        } else if(id == BTN_ID_PATTERN && clickPending) {
+            clickPending = 0;
+            if(t - clickTime <= GESTURE_DOUBLE_MS) {
+                consumedMask |= mask;   // Second press of a double click
+                recall_favorite();
+            } else {
+                gesture_click(id);      // Late second press: first was a click
+            }
+        }
+        return;
+    }
+
+    heldMask &= ~mask;
+    if(consumedMask & mask) {
+        consumedMask &= ~mask;
+    } else if(id == BTN_ID_PATTERN && !menuActive) {
+        clickPending = 1;               // Decided once the window closes
+        clickTime = t;
+    } else {
+        gesture_click(id);
+    }
+}
+
+// Double-click window and long-press detection, run by TASK_GESTURES
+void gesture_timeouts() {
+    uint8_t id, mask;
+
+    if(!heldMask && !clickPending) return;
+
+    if(clickPending && nowMs - clickTime > GESTURE_DOUBLE_MS) {
+        clickPending = 0;
+        gesture_click(BTN_ID_PATTERN);
+    }
+
+    // Long press fires while the button is still held
+    for(id=BTN_ID_PATTERN; id<=BTN_ID_SPEED; id++) {
+        mask = 1 << id;
+        if((heldMask & ~consumedMask & mask) && nowMs - pressTime[id] >= GESTURE_LONG_MS) {
+            consumedMask |= mask;
+            gesture_long(id);
+        }
+    }
+}
+
+void gesture_click(uint8_t id) {
+    if(menuActive) {
+        if(id == BTN_ID_POWER) {
+            menuActive = 0;
+            updateStatusLEDs();
+        } else if(id == BTN_ID_PATTERN) {
+            if(++menuItem >= MENU_ITEMS) menuItem = 0;
+            updateStatusLEDs();
+        } else if(id == BTN_ID_SPEED) {
+            menu_apply();
+        }
+        return;
+    }
+
+    switch(id) {
+        case BTN_ID_POWER:
+            set_power(!isActive);
+            break;
+        case BTN_ID_PATTERN:
+            set_pattern(pattern_step(currentPattern, 0));
+            break;
+        case BTN_ID_SPEED:
+            set_speed(currentSpeed + 1 < NUM_SPEEDS ? currentSpeed + 1 : 0);
+            break;
+        case BTN_ID_RANGE:
+            set_range(!currentRange);
+            break;
+    }
+}
+
+void gesture_long(uint8_t id) {
+    if(menuActive) return;
+    if(id == BTN_ID_PATTERN)
+        set_pattern(pattern_step(currentPattern, 1));
+    else
+        set_speed(currentSpeed ? currentSpeed - 1 : NUM_SPEEDS - 1);
+}
+
+void recall_favorite() {
+    uint8_t pattern = favorites[favoriteIndex][0];
+    uint8_t speedRange = favorites[favoriteIndex][1];
+    if(++favoriteIndex >= NUM_FAVORITES) favoriteIndex = 0;
+
+    if((speedRange >> 7) != currentRange) set_range(speedRange >> 7);
+    set_speed(speedRange & 0x7F);
+    set_pattern(pattern_valid(pattern) ? pattern : 0);
+}
+
+void menu_apply() {
+#if SCHEDULE_ENABLE
+    static uint8_t autoOffPreset = 0;
+    static uint8_t dutyPreset = 0;
+    static const uint16_t autoOffPresets[5] = {0, 300, 900, 1800, 3600};  // s
+    static const uint8_t dutyPresets[4][2] = {{0, 0}, {10, 50}, {30, 30}, {60, 240}};
+#endif
+
+    if(menuItem < NUM_FAVORITES) {
+        favorites[menuItem][0] = currentPattern;
+        favorites[menuItem][1] = currentSpeed | (currentRange ? 0x80 : 0);
+    }
+#if SCHEDULE_ENABLE
+    else if(menuItem == MENU_AUTO_OFF) {
+        if(++autoOffPreset >= 5) autoOffPreset = 0;
+        autoOffSeconds = autoOffPresets[autoOffPreset];
+        schedule_restart();
+    } else {
+        if(++dutyPreset >= 4) dutyPreset = 0;
+        dutyOnSeconds = dutyPresets[dutyPreset][0];
+        dutyOffSeconds = dutyPresets[dutyPreset][1];
+        schedule_restart();
+    }
+#endif
+}
+
+/*----- State Changes -----*/
+// Shared by the buttons and the serial commands
+void set_power(__bit on) {
+    isActive = on;
+    if(!isActive) output_park();
+    else gate_apply();            // Outputs may have been parked low
+#if SCHEDULE_ENABLE
+    schedule_restart();
+#endif
+    updateStatusLEDs();
+    state_changed();
+}
+
+void set_pattern(uint8_t pattern) {
+    currentPattern = pattern;
+    pattern_restart();
+    updateStatusLEDs();  // No LED for patterns 11-15, all pattern LEDs off
+    state_changed();
+}
+
+// Starts currentPattern from the top
+void pattern_restart() {
+#if CALIBRATE_ENABLE
+    // Timer 2 and the delay belong to a running calibration, which restarts
+    // the pattern when it finishes
+    if(calActive) return;
+#endif
+    patternStart = 1;
+    envelope_reset();
+    if(currentPattern == HOP_PATTERN) {
+        currentFreqDelay = hopSet[hopLfsr & (HOP_SET_SIZE - 1)];
+    } else if(currentPattern == USER_PATTERN) {
+        // Start the uploaded table from its first point
+        userIndex = 0;
+        userPointStart = nowMs;
+        currentFreqDelay = userTable[0].delay;
+    }
+#if RESONANCE_ENABLE
+    else if(currentPattern == RESO_PATTERN) reso_start();
+#endif
+    else if(currentPattern != BURST_PATTERN && currentPattern != RANGE_PATTERN) {
+        delay_step(0);            // Into the range if a burst or ping delay was left
+    }
+}
+
+void set_speed(uint8_t speed) {
+    currentSpeed = speed;
+    updateStatusLEDs();
+    state_changed();
+}
+
+void set_range(__bit range) {
+    currentRange = range;
+#if CALIBRATE_ENABLE
+    if(!calActive)                // cal_finish() sets it from the new limits
+#endif
+        currentFreqDelay = rangeParams[currentRange][2];
+    if(!hopCustom) hop_default_set();
+    updateStatusLEDs();
+    state_changed();
+}
+
+// Common hook for every setting change
+void state_changed() {
+#if EEPROM_ENABLE
+    settings_changed();
+#endif
+#if WATCHDOG_ENABLE
+    warm_save();
+#endif
+#if SCHEDULE_ENABLE
+    autoOffLeft = autoOffSeconds;  // Auto-off counts from the last interaction
+#endif
+    note_activity();
+}
+
+uint8_t status_flags() {
+    uint8_t flags = 0;
+    if(isActive) flags |= PROTO_FLAG_ACTIVE;
+    if(currentRange) flags |= PROTO_FLAG_RANGE;
+#if SCHEDULE_ENABLE
+    if(dutyResting) flags |= PROTO_FLAG_RESTING;
+#endif
+    if(voice2Mode) flags |= PROTO_FLAG_VOICE2;
+#if CALIBRATE_ENABLE
+    if(calActive) flags |= PROTO_FLAG_CALIBRATING;
+#endif
+    return flags;
+}
+
+void note_activity() {
+#if POWER_SAVE_ENABLE
+    quietSince = uptime_ms();
+#endif
+}
+
+/*----- CRC-8 -----*/
+// Polynomial 0x07, used by serial frames and journal records
+uint8_t crc8_update(uint8_t crc, uint8_t b) {
+    uint8_t i;
+    crc ^= b;
+    for(i=0; i<8; i++)
+        crc = (crc & 0x80) ? (crc << 1) ^ PROTO_CRC_POLY : (crc << 1);
+    return crc;
+}
+
+/*----- I2C EEPROM -----*/
+#if I2C_ENABLE
+// Bit-banged master; at 12MHz each line change takes >=1us, within 24Cxx
+// timing. Faster crystals pad the clock high time back to about 1us.
+#if FOSC_HZ > 24000000UL
+#define I2C_PAD() __asm__("nop\n nop")
+#elif FOSC_HZ > 12000000UL
+#define I2C_PAD() __asm__("nop")
+#else
+#define I2C_PAD()
+#endif
+
+void i2c_start() {
+    I2C_SDA = 1;
+    I2C_SCL = 1;
+    I2C_PAD();
+    I2C_SDA = 0;
+    I2C_PAD();
+    I2C_SCL = 0;
+}
+
+void i2c_stop() {
+    I2C_SDA = 0;
+    I2C_SCL = 1;
+    I2C_PAD();
+    I2C_SDA = 1;
+}
+
+__bit i2c_write(uint8_t b) {
+    uint8_t i;
+    __bit ack;
+    for(i=0; i<8; i++) {
+        I2C_SDA = (b & 0x80) ? 1 : 0;
+        I2C_SCL = 1;
+        I2C_PAD();
+        b <<= 1;
+        I2C_SCL = 0;
+    }
+    I2C_SDA = 1;           // Release SDA for the ACK bit
+    I2C_SCL = 1;
+    I2C_PAD();
+    ack = !I2C_SDA;
+    I2C_SCL = 0;
+    return ack;
+}
+
+uint8_t i2c_read(__bit ack) {
+    uint8_t i, b = 0;
+    I2C_SDA = 1;
+    for(i=0; i<8; i++) {
+        I2C_SCL = 1;
+        I2C_PAD();
+        b = (b << 1) | I2C_SDA;
+        I2C_SCL = 0;
+    }
+    I2C_SDA = !ack;
+    I2C_SCL = 1;
+    I2C_PAD();
+    I2C_SCL = 0;
+    I2C_SDA = 1;
+    return b;
+}
+#endif
+
+#if EEPROM_ENABLE
+// Random read of n bytes; returns 0 when the device does not answer
+__bit eeprom_read(uint16_t addr, uint8_t *buf, uint8_t n) {
+    i2c_start();
+    if(!i2c_write(EEPROM_DEV)) {
+        i2c_stop();
+        return 0;
+    }
+#if EEPROM_ADDR_BYTES == 2
+    i2c_write(addr >> 8);
+#endif
+    i2c_write(addr & 0xFF);
+    i2c_start();           // Repeated start
+    i2c_write(EEPROM_DEV | 1);
+    while(n--) *buf++ = i2c_read(n != 0);
+    i2c_stop();
+    return 1;
+}
+
+/*----- Settings Journal -----*/
+// Slots are written round-robin with an incrementing sequence number, so the
+// slots of the current lap hold seq0, seq0+1, ... and a binary search finds
+// the newest one in log2(JOURNAL_SLOTS) single-byte reads.
+void settings_restore() {
+    uint8_t lo = 0, hi = JOURNAL_SLOTS - 1, mid;
+    uint8_t seq0, seq, tries, crc, i;
+    uint8_t rec[4];
+
+    if(!eeprom_read(JOURNAL_BASE, &seq0, 1)) return;  // No EEPROM fitted
+    eepromPresent = 1;
+
+    while(lo < hi) {
+        mid = (lo + hi + 1) >> 1;
+        eeprom_read(JOURNAL_BASE + mid * 4, &seq, 1);
+        if((uint8_t)(seq - seq0) == mid) lo = mid;
+        else hi = mid - 1;
+    }
+    journalSlot = (lo + 1) & (JOURNAL_SLOTS - 1);
+    journalSeq = seq0 + lo + 1;
+
+    // A torn write leaves a bad CRC in the newest slot, fall back one slot
+    for(tries=0; tries<2; tries++) {
+        eeprom_read(JOURNAL_BASE + lo * 4, rec, 4);
+        crc = 0;
+        for(i=0; i<3; i++) crc = crc8_update(crc, rec[i]);
+        if(crc == rec[3]) {
+            // The uploaded table does not survive power loss
+            currentPattern = pattern_valid(rec[1]) ? rec[1] : 0;
+            currentSpeed = (rec[2] >> 4) < NUM_SPEEDS ? (rec[2] >> 4) : 0;
+            currentRange = (rec[2] & 0x02) ? 1 : 0;
+            isActive = rec[2] & 0x01;
+            return;
+        }
+        lo = (lo - 1) & (JOURNAL_SLOTS - 1);
+    }
+}
+
+void settings_changed() {
+    if(!eepromPresent) return;    // Nothing to save, and power_save() waits on the flag
+    settingsDirty = 1;
+    settingsChangedAt = nowMs;
+}
+
+// Writes one I2C byte per TASK_SETTINGS run so the tone keeps running during a save
+void settings_service() {
+    static uint8_t rec[4];
+    static uint16_t addr;
+    __bit ack = 1;
+
+    switch(journalState) {
+        case 0:  // Coalesce changes until the settings stay put
+            if(nowMs - settingsChangedAt < SETTINGS_SAVE_DELAY) return;
+            settingsDirty = 0;
+            rec[0] = journalSeq;
+            rec[1] = currentPattern;
+            rec[2] = (currentSpeed << 4) | (currentRange ? 0x02 : 0) | (isActive ? 0x01 : 0);
+            rec[3] = crc8_update(crc8_update(crc8_update(0, rec[0]), rec[1]), rec[2]);
+            addr = JOURNAL_BASE + journalSlot * 4;
+            i2c_start();
+            ack = i2c_write(EEPROM_DEV);
+            break;
+#if EEPROM_ADDR_BYTES == 2
+        case 1:  ack = i2c_write(addr >> 8);   break;
+#else
+        case 1:  break;
+#endif
+        case 2:  ack = i2c_write(addr & 0xFF); break;
+        case 3:
+        case 4:
+        case 5:
+        case 6:  ack = i2c_write(rec[journalState - 3]); break;
+        default: // Stop starts the internal write cycle (~5ms, far below the save delay)
+            i2c_stop();
+            journalSlot = (journalSlot + 1) & (JOURNAL_SLOTS - 1);
+            journalSeq++;
+            journalState = 0;
+            return;
+    }
+
+    if(ack) {
+        journalState++;
+    } else {
+        // Device busy or gone: retry the whole record after another delay
+        i2c_stop();
+        journalState = 0;
+        settings_changed();
+    }
+}
+#endif
+
+/*----- Serial Protocol -----*/
+#if UART_ENABLE
+void uart_init() {
+    SCON = 0x50;                  // Mode 1, 8N1, receiver enabled
+    PCON |= 0x80;                 // SMOD=1 doubles the baud rate
+    TMOD = (TMOD & 0x0F) | 0x20;  // Timer 1 mode 2 (auto-reload)
+    TH1 = TL1 = T1_RELOAD(PROTO_BAUD);  // 4808 baud @12MHz, exact @11.0592MHz
+    TR1 = 1;
+    ES = 1;
+}
+
+void uart_putc(uint8_t c) {
+    uint8_t next = (uartTxHead + 1) & (UART_TX_SIZE - 1);
+    while(next == uartTxTail) {   // Only waits when the ring is full
+        tone_step();
+        wdt_feed();               // Bounded by the line rate, ~2ms per byte
+    }
+    uartTxBuf[uartTxHead] = c;
+    uartTxHead = next;
+    if(!uartTxBusy) {
+        uartTxBusy = 1;
+        TI = 1;                   // Kick Serial_ISR to start sending
+    }
+}
+
+void send_frame(uint8_t cmd, const uint8_t *payload, uint8_t len) {
+    uint8_t crc = crc8_update(crc8_update(0, cmd), len);
+    uart_putc(PROTO_SYNC);
+    uart_putc(cmd);
+    uart_putc(len);
+    while(len--) {
+        crc = crc8_update(crc, *payload);
+        uart_putc(*payload++);
+    }
+    uart_putc(crc);
+}
+
+void send_status() {
+    uint8_t buf[5];
+    buf[0] = status_flags();
+    buf[1] = currentPattern;
+    buf[2] = currentSpeed;
+    buf[3] = currentFreqDelay >> 8;
+    buf[4] = currentFreqDelay & 0xFF;
+    send_frame(PROTO_RSP_STATUS, buf, 5);
+}
+
+void send_telemetry() {
+    uint8_t buf[PROTO_TELEMETRY_LEN];
+    uint16_t idle = 0;
+    uint16_t range = PROTO_RANGE_NONE;
+#if POWER_SAVE_ENABLE
+    EA = 0;                       // 16-bit value shared with Timer0_ISR
+    idle = idleTicks;
+    idleTicks = 0;
+    EA = 1;
+#endif
+    buf[0] = telemetrySeq++;
+    buf[1] = status_flags();
+    buf[2] = currentPattern;
+    buf[3] = currentSpeed;
+    buf[4] = currentFreqDelay >> 8;
+    buf[5] = currentFreqDelay & 0xFF;
+    buf[6] = loopCount >> 8;
+    buf[7] = loopCount & 0xFF;
+    buf[8] = idle >> 8;
+    buf[9] = idle & 0xFF;
+    buf[10] = evOverflows;
+    buf[11] = uartRxOverruns;
+#if WATCHDOG_ENABLE
+    buf[12] = warmBlock.restarts;
+#else
+    buf[12] = 0;
+#endif
+#if RANGING_ENABLE
+    if(currentPattern == RANGE_PATTERN) range = rangeMm;
+#endif
+    buf[13] = range >> 8;
+    buf[14] = range & 0xFF;
+    buf[15] = 0;
+#if RESONANCE_ENABLE
+    if(currentPattern == RESO_PATTERN) buf[15] = resoLevel;
+#endif
+    loopCount = 0;
+    send_frame(PROTO_RSP_TELEMETRY, buf, PROTO_TELEMETRY_LEN);
+}
+
+void handle_command(uint8_t cmd, const uint8_t *arg, uint8_t len) {
+    uint8_t err = 0;
+    uint8_t reply[2];
+
+    note_activity();  // Host traffic keeps the unit out of POWER-DOWN
+
+    switch(cmd) {
+        case PROTO_CMD_PING:
+            break;
+
+        case PROTO_CMD_GET_STATUS:
+            send_status();
+            return;
+
+        case PROTO_CMD_SET_POWER:
+            if(len != 1) err = PROTO_ERR_LEN;
+            else if(arg[0] > 1) err = PROTO_ERR_ARG;
+            else set_power(arg[0]);
+            break;
+
+        case PROTO_CMD_SET_PATTERN:
+            if(len != 1) err = PROTO_ERR_LEN;
+            else if(arg[0] >= NUM_PATTERNS) err = PROTO_ERR_ARG;
+            else if(!pattern_valid(arg[0])) err = PROTO_ERR_STATE;
+            else set_pattern(arg[0]);
+            break;
+
+        case PROTO_CMD_SET_SPEED:
+            if(len != 1) err = PROTO_ERR_LEN;
+            else if(arg[0] >= NUM_SPEEDS) err = PROTO_ERR_ARG;
+            else set_speed(arg[0]);
+            break;
+
+        case PROTO_CMD_SET_RANGE:
+            if(len != 1) err = PROTO_ERR_LEN;
+            else if(arg[0] > 1) err = PROTO_ERR_ARG;
+            else set_range(arg[0]);
+            break;
+
+        case PROTO_CMD_TELEMETRY:
+            if(len != 1) err = PROTO_ERR_LEN;
+            else if(arg[0] && arg[0] < PROTO_TELEMETRY_MIN_PERIOD) err = PROTO_ERR_ARG;
+            else {
+                telemetryPeriod = arg[0];
+                task_set_period(TASK_TELEMETRY, arg[0] * 10);
+            }
+            break;
+
+#if SCHEDULE_ENABLE
+        case PROTO_CMD_SET_SCHEDULE:
+            if(len != 6) err = PROTO_ERR_LEN;
+            else if((arg[4] | arg[5]) && !(arg[2] | arg[3])) err = PROTO_ERR_ARG;  // Rest needs an on phase
+            else {
+                autoOffSeconds = ((uint16_t)arg[0] << 8) | arg[1];
+                dutyOnSeconds  = ((uint16_t)arg[2] << 8) | arg[3];
+                dutyOffSeconds = ((uint16_t)arg[4] << 8) | arg[5];
+                schedule_restart();
+            }
+            break;
+#endif
+
+        case PROTO_CMD_SET_VOICE2:
+            if(len != 3) err = PROTO_ERR_LEN;
+            else err = voice2_set(arg[0], ((uint16_t)arg[1] << 8) | arg[2]);
+            break;
+
+        case PROTO_CMD_SET_HOP:
+            err = hop_config(arg, len);
+            break;
+
+        case PROTO_CMD_SET_BURST:
+            err = burst_config(arg, len);
+            break;
+
+#if CALIBRATE_ENABLE
+        case PROTO_CMD_CALIBRATE:
+            if(len != 0) err = PROTO_ERR_LEN;
+            else if(calActive) err = PROTO_ERR_STATE;
+            else cal_start();
+            break;
+#endif
+
+        case PROTO_CMD_TABLE_BEGIN:
+        case PROTO_CMD_TABLE_DATA:
+        case PROTO_CMD_TABLE_COMMIT:
+            err = table_command(cmd, arg, len);
+            break;
+
+        default:
+            err = PROTO_ERR_CMD;
+            break;
+    }
+
+    reply[0] = cmd;
+    reply[1] = err;
+    if(err) send_frame(PROTO_RSP_NAK, reply, 2);
+    else    send_frame(PROTO_RSP_ACK, reply, 1);
+}
+
+uint16_t table_crc16() {
+    uint16_t crc = PROTO_CRC16_INIT;
+    uint8_t i, j, k, b;
+    for(i=0; i<userTableCount; i++) {
+        for(k=0; k<4; k++) {
+            switch(k) {
+                case 0:  b = userTable[i].delay >> 8;   break;
+                case 1:  b = userTable[i].delay & 0xFF; break;
+                case 2:  b = userTable[i].dwell >> 8;   break;
+                default: b = userTable[i].dwell & 0xFF; break;
+            }
+            crc ^= (uint16_t)b << 8;
+            for(j=0; j<8; j++)
+                crc = (crc & 0x8000) ? (crc << 1) ^ PROTO_CRC16_POLY : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+uint8_t table_command(uint8_t cmd, const uint8_t *arg, uint8_t len) {
+    uint8_t i, n;
+
+    switch(cmd) {
+        case PROTO_CMD_TABLE_BEGIN:
+            if(len != 1) return PROTO_ERR_LEN;
+            if(arg[0] == 0 || arg[0] > USER_TABLE_MAX) return PROTO_ERR_ARG;
+            // The table is rewritten in place, so stop playing it first
+            userTableValid = 0;
+            if(currentPattern == USER_PATTERN) set_pattern(0);
+            userTableCount = arg[0];
+            return 0;
+
+        case PROTO_CMD_TABLE_DATA:
+            if(len < 5 || ((len - 1) & 3)) return PROTO_ERR_LEN;
+            n = (len - 1) >> 2;
+            if(userTableValid || arg[0] + n > userTableCount) return PROTO_ERR_ARG;
+            i = *arg++;
+            while(n--) {
+                userTable[i].delay = ((uint16_t)arg[0] << 8) | arg[1];
+                userTable[i].dwell = ((uint16_t)arg[2] << 8) | arg[3];
+                if(!userTable[i].delay || !userTable[i].dwell) return PROTO_ERR_ARG;
+                i++;
+                arg += 4;
+            }
+            return 0;
+
+        case PROTO_CMD_TABLE_COMMIT:
+            if(len != 2) return PROTO_ERR_LEN;
+            if(!userTableCount || userTableValid) return PROTO_ERR_STATE;
+            if(table_crc16() != (((uint16_t)arg[0] << 8) | arg[1])) return PROTO_ERR_CRC;
+            userTableWide = 0;
+            for(i=0; i<userTableCount; i++)
+                if(userTable[i].delay > 0xFF) userTableWide = 1;
+            userTableValid = 1;
+            return 0;
+    }
+    return PROTO_ERR_CMD;
+}
+
+void serial_poll() {
+    static uint8_t rxState = 0;   // 0=sync 1=cmd 2=len 3=payload 4=crc
+    static uint8_t cmd, len, idx, crc;
+    static BULK_RAM uint8_t payload[PROTO_MAX_PAYLOAD];
+    uint8_t c, reply[2];
+
+    while(uartRxTail != uartRxHead) {
+        c = uartRxBuf[uartRxTail];
+        uartRxTail = (uartRxTail + 1) & (UART_RX_SIZE - 1);
+
+        switch(rxState) {
+            case 0:
+                if(c == PROTO_SYNC) rxState = 1;
+                break;
+            case 1:
+                cmd = c;
+                crc = crc8_update(0, c);
+                rxState = 2;
+                break;
+            case 2:
+                len = c;
+                crc = crc8_update(crc, c);
+                idx = 0;
+                if(len > PROTO_MAX_PAYLOAD) rxState = 0;  // Resync
+                else rxState = len ? 3 : 4;
+                break;
+            case 3:
+                payload[idx++] = c;
+                crc = crc8_update(crc, c);
+                if(idx >= len) rxState = 4;
+                break;
+            case 4:
+                rxState = 0;
+                if(c == crc) {
+                    handle_command(cmd, payload, len);
+                } else {
+                    reply[0] = cmd;
+                    reply[1] = PROTO_ERR_CRC;
+                    send_frame(PROTO_RSP_NAK, reply, 2);
+                }
+                break;
         }
     }
+}
+#endif
+
+/*----- Power Management -----*/
+#if POWER_SAVE_ENABLE
+// Called once per main-loop pass while the unit is off or resting
+void power_save() {
+    if(!isActive && uptime_ms() - quietSince >= POWER_DOWN_DELAY
+       && evTail == evHead && !heldMask
+       && btnPhase[BTN_ID_POWER] == BTN_IDLE && btnPhase[BTN_ID_PATTERN] == BTN_IDLE
+#if EEPROM_ENABLE
+       && !settingsDirty && !journalState
+#endif
+#if UART_ENABLE
+       && !telemetryPeriod && !uartTxBusy && uartRxTail == uartRxHead
+#endif
+      ) {
+        power_down();
+        return;
+    }
+
+    cpu_idle();
+}
+
+// Nothing to do until the next Timer 0 tick or serial byte
+void cpu_idle() {
+    cpuIdle = 1;
+    PCON |= 0x01;                 // IDL
+    cpuIdle = 0;
+}
+
+void power_down() {
+    output_park();
+    wdt_feed();                   // The watchdog freezes with the oscillator
+    IT0 = 0;                      // Only a level-triggered INT0 ends POWER-DOWN
+    PCON |= 0x02;                 // PD: oscillator stops here
+    // Ext0_ISR ran and started debouncing BTN_POWER, whose press event
+    // then switches the unit on
+    IT0 = 1;
+    note_activity();
+}
+#endif
+
+/*----- Run Schedule -----*/
+#if SCHEDULE_ENABLE
+// Starts a fresh on phase, called at power-on and when the schedule changes
+void schedule_restart() {
+    if(dutyResting) {
+        dutyResting = 0;
+        gate_apply();
+    }
+    phaseLeft = dutyOnSeconds;
+    autoOffLeft = autoOffSeconds;
+}
+
+// Called once a second by TASK_SCHEDULE while active
+void schedule_second() {
+    if(autoOffSeconds && --autoOffLeft == 0) {
+        set_power(0);
+        return;
+    }
+
+    if(dutyOffSeconds && --phaseLeft == 0) {
+        dutyResting = !dutyResting;
+        if(dutyResting) {
+            output_park();
+            phaseLeft = dutyOffSeconds;
+        } else {
+            gate_apply();
+            phaseLeft = dutyOnSeconds;
+        }
+    }
+}
+#endif
+
+/*----- Watchdog -----*/
+// The first write sequence starts the watchdog, later ones restart its count
+void wdt_feed() {
+#if WATCHDOG_ENABLE
+    WDTRST = 0x1E;
+    WDTRST = 0xE1;
+#endif
+}
+
+#if WATCHDOG_ENABLE
+uint8_t warm_crc() {
+    __idata uint8_t *p = (__idata uint8_t *)&warmBlock;
+    uint8_t crc = 0, i;
+    for(i=0; i<sizeof(warmBlock) - 1; i++) crc = crc8_update(crc, p[i]);
+    return crc;
+}
+
+// Called on every state change, so a reset at any time finds the latest state
+void warm_save() {
+    warmBlock.magic = WARM_MAGIC;
+    warmBlock.pattern = currentPattern;
+    warmBlock.speed = currentSpeed;
+    warmBlock.flags = (isActive ? PROTO_FLAG_ACTIVE : 0) | (currentRange ? PROTO_FLAG_RANGE : 0);
+    warmBlock.crc = warm_crc();
+}
+
+// Runs before interrupts are enabled. RAM still holds whatever the reset
+// interrupted, so everything an ISR or a half-done exchange may have left
+// behind starts over; the user state comes from warmBlock.
+void warm_resume() {
+    uint8_t i;
+
+    evHead = evTail = 0;
+    for(i=0; i<NUM_BUTTONS; i++) btnPhase[i] = BTN_IDLE;
+    heldMask = consumedMask = 0;
+    clickPending = 0;
+    menuActive = 0;
+#if UART_ENABLE
+    uartRxHead = uartRxTail = 0;
+    uartTxHead = uartTxTail = 0;
+    uartTxBusy = 0;
+#endif
+#if EEPROM_ENABLE
+    journalState = 0;             // A torn record fails its CRC, write it again
+    if(eepromPresent) settingsDirty = 1;
+#endif
+#if POWER_SAVE_ENABLE
+    cpuIdle = 0;
+#endif
+
+    currentPattern = pattern_valid(warmBlock.pattern) ? warmBlock.pattern : 0;
+    currentSpeed = warmBlock.speed < NUM_SPEEDS ? warmBlock.speed : 0;
+    currentRange = (warmBlock.flags & PROTO_FLAG_RANGE) ? 1 : 0;
+    isActive = warmBlock.flags & PROTO_FLAG_ACTIVE;
+#if CALIBRATE_ENABLE
+    calActive = 0;                // Timer 2 was reset, the table keeps its last values
+#endif
+    warmBlock.restarts++;
+}
+#endif
+
+/*----- Startup -----*/
+#if defined(SDCC) && SDCC < 420
+#define __sdcc_external_startup _sdcc_external_startup  // Name before SDCC 4.2
+#endif
+
+// First code after reset, before the C runtime clears RAM; returning 1 skips
+// the clear and the variable initializers
+unsigned char __sdcc_external_startup() {
+    BUZZER = 0;                   // Ports reset high: park the transducer
+    BUZZER_COMP = 0;              // before anything else runs
+#if WATCHDOG_ENABLE
+    if(!(PCON & PCON_POF) && warmBlock.magic == WARM_MAGIC && warmBlock.crc == warm_crc()) {
+        warmStart = 1;
+        return 1;
+    }
+    PCON &= ~PCON_POF;            // Any later reset short of a power cycle is warm
+#endif
     return 0;
 }
 
 /*----- Tone Generation -----*/
 void generate_tone() {
-    static uint16_t toneCounter = 0;
+    static uint16_t voice2Counter = 0;
+    uint16_t delay2;
+
     if(++toneCounter >= currentFreqDelay) {
         toneCounter = 0;
-        BUZZER = !BUZZER;
-        BUZZER_COMP = !BUZZER_COMP;
+        if(tone_toggle()) return;
+    }
+    if(compMode == COMP_VOICE2) {
+        delay2 = voice2Value;
+        if(voice2Mode == PROTO_VOICE2_DETUNE) {
+            // Saturate rather than wrap: calibration, hop sets, tables and
+            // bursts can play delays below -PROTO_VOICE2_MIN_DETUNE
+            delay2 += currentFreqDelay;
+            if((int16_t)voice2Value < 0) {
+                if(!delay2 || delay2 >= currentFreqDelay) delay2 = 1;
+            } else if(delay2 < currentFreqDelay) {
+                delay2 = 0xFFFF;
+            }
+        }
+        if(++voice2Counter >= delay2) {
+            voice2Counter = 0;
+            BUZZER_COMP = !BUZZER_COMP;
+        }
+    }
+}
+
+// generate_tone() with a one-byte counter and compare, for when the delay
+// fits in a byte and BUZZER_COMP has no voice of its own. Every range and
+// the built-in patterns qualify, so this is the usual hot path.
+void generate_tone8() {
+    if(++toneCounter8 >= (uint8_t)currentFreqDelay) {
+        toneCounter8 = 0;
+        tone_toggle();
+    }
+}
+
+// The half-period edge shared by both tone paths; returns 1 when it ended a
+// burst and shut the gate
+__bit tone_toggle() {
+    BUZZER = !BUZZER;
+    if(compMode == COMP_MIRROR) BUZZER_COMP = !BUZZER_COMP;
+    if(burstToggles && --burstToggles == 0) {
+        gateLevel = GATE_OFF;     // BUZZER is back low after whole periods
+        BUZZER_COMP = 0;
+        return 1;
+    }
+    return 0;
+}
+
+// One step of the tone engine, from the main loop and from blocking sends:
+// the path tone_select() picked while the gate is open, else the
+// calibration tone. Returns 0 when there is nothing to play.
+__bit tone_step() {
+    if(isActive && !dutyResting && gateLevel) {
+        if(toneNarrow) generate_tone8();
+        else generate_tone();
+        return 1;
+    }
+#if CALIBRATE_ENABLE
+    if(calActive) {
+        generate_tone8();
+        return 1;
     }
+#endif
+    return 0;
+}
+
+// Picks the tone path for the current pattern and output mode. Range limits,
+// hop sets and calibration delays always fit a byte (FOSC_SCALE(50) is 138
+// at 33MHz, calibration stops at 174); uploaded tables and bursts may not.
+void tone_select() {
+    toneNarrow = compMode != COMP_VOICE2
+                 && !(currentPattern == USER_PATTERN && userTableWide)
+                 && !(currentPattern == BURST_PATTERN && burstDelay > 0xFF);
+#if CALIBRATE_ENABLE
+    if(calActive) toneNarrow = 1;
+#endif
+}
+
+// Returns a PROTO_ERR_* code, 0 on success
+uint8_t voice2_set(uint8_t mode, uint16_t value) {
+    if(mode > PROTO_VOICE2_DETUNE) return PROTO_ERR_ARG;
+    if(mode == PROTO_VOICE2_CARRIER && value == 0) return PROTO_ERR_ARG;
+    if(mode == PROTO_VOICE2_DETUNE && (int16_t)value < PROTO_VOICE2_MIN_DETUNE) return PROTO_ERR_ARG;
+    voice2Mode = mode;
+    voice2Value = value;
+    gate_apply();
+    return 0;
+}
+
+/*----- Gate Envelope -----*/
+void gate_set(uint8_t level) {
+    gateLevel = level;
+    gate_apply();
+}
+
+// Sets up BUZZER_COMP for the gate level and voice mode, and the lines
+// themselves unless the output is parked (off or resting)
+void gate_apply() {
+    compMode = COMP_PARKED;
+    if(gateLevel == GATE_FULL) compMode = voice2Mode ? COMP_VOICE2 : COMP_MIRROR;
+    tone_select();
+    if(!isActive || dutyResting) return;
+    if(gateLevel == GATE_OFF) BUZZER = 0;
+    if(compMode == COMP_MIRROR) BUZZER_COMP = !BUZZER;
+    else if(compMode == COMP_PARKED) BUZZER_COMP = 0;
 }
 
+void output_park() {
+    BUZZER = 0;                   // Park both transducer lines low
+    BUZZER_COMP = 0;
+}
+
+// Gated patterns start silent and open the gate themselves
+void envelope_reset() {
+    burstToggles = 0;
+#if RANGING_ENABLE
+    range_stop();
+#endif
+    if(currentPattern == PATTERN_PULSE || currentPattern == PATTERN_HEARTBEAT
+       || currentPattern == BURST_PATTERN || currentPattern == RANGE_PATTERN) {
+        envPhase = ENV_CLOSED;
+        gate_set(GATE_OFF);
+    } else {
+        envPhase = ENV_OPEN;
+        gate_set(GATE_FULL);
+    }
+}
+
+// One note: attack at half drive, hold at full, release at half, then shut
+void envelope_trigger(uint8_t attack, uint8_t hold, uint8_t release) {
+    envHold = hold;
+    envRelease = release;
+    envLeft = attack;
+    envelope_enter(ENV_ATTACK);
+}
+
+// Enters phase, skipping phases of zero length
+void envelope_enter(uint8_t phase) {
+    for(;;) {
+        envPhase = phase;
+        if(phase == ENV_HOLD) envLeft = envHold;
+        else if(phase == ENV_RELEASE) envLeft = envRelease;
+        else if(phase == ENV_CLOSED) {
+            gate_set(GATE_OFF);
+            return;
+        }
+        if(envLeft) break;
+        phase++;
+    }
+    gate_set(phase == ENV_HOLD ? GATE_FULL : GATE_HALF);
+}
+
+// Once per tick from TASK_PATTERN
+void envelope_tick() {
+    if(envPhase == ENV_OPEN || envPhase == ENV_CLOSED) return;
+    if(--envLeft == 0) envelope_enter(envPhase + 1);
+}
+
+/*----- Frequency Hopping -----*/
+// Spreads the set evenly over the current range
+void hop_default_set() {
+    uint8_t minDelay = rangeParams[currentRange][0];
+    uint8_t span = rangeParams[currentRange][1] - minDelay;
+    uint8_t i;
+    for(i=0; i<HOP_SET_SIZE; i++)
+        hopSet[i] = minDelay + (uint8_t)((uint16_t)span * i / (HOP_SET_SIZE - 1));
+}
+
+// PROTO_CMD_SET_HOP: period alone keeps the range-based set, period plus a
+// full set installs absolute delays. Returns a PROTO_ERR_* code, 0 on success.
+uint8_t hop_config(const uint8_t *arg, uint8_t len) {
+    uint8_t i;
+
+    if(len != 1 && len != 1 + HOP_SET_SIZE) return PROTO_ERR_LEN;
+    if(arg[0] == 0) return PROTO_ERR_ARG;
+    for(i=1; i<len; i++) {
+        if(arg[i] == 0) return PROTO_ERR_ARG;
+    }
+    hopPeriod = arg[0];
+    hopCustom = (len > 1);
+    if(hopCustom) {
+        for(i=0; i<HOP_SET_SIZE; i++) hopSet[i] = arg[1 + i];
+    } else {
+        hop_default_set();
+    }
+    return 0;
+}
+
+/*----- Tone Bursts -----*/
+// Starts a burst from a parked BUZZER and a fresh half period, so every
+// burst has the same phase and exactly the given number of periods
+void burst_fire(uint8_t cycles, uint16_t delay) {
+    currentFreqDelay = delay;
+    toneCounter = toneCounter8 = 0;
+    burstToggles = (uint16_t)cycles * 2;
+    gate_set(GATE_FULL);
+}
+
+// PROTO_CMD_SET_BURST, returns a PROTO_ERR_* code, 0 on success
+uint8_t burst_config(const uint8_t *arg, uint8_t len) {
+    uint16_t delay, gap;
+
+    if(len != 5) return PROTO_ERR_LEN;
+    delay = ((uint16_t)arg[1] << 8) | arg[2];
+    gap = ((uint16_t)arg[3] << 8) | arg[4];
+    if(arg[0] == 0 || delay == 0 || gap == 0) return PROTO_ERR_ARG;
+    burstCycles = arg[0];
+    burstDelay = delay;
+    burstGap = gap;
+    tone_select();
+    return 0;
+}
+
+#if RANGING_ENABLE
+/*----- Echo Ranging -----*/
+// Converts the previous ping's flight time, then sends the next ping with
+// Timer 2 counting from zero, at the top of the 18-27kHz range. The first
+// edge comes one half period after the count starts; that offset is left in
+// the result.
+void range_ping() {
+    uint16_t counts;
+
+    ET2 = 0;                      // 16-bit value shared with Timer2_ISR
+    counts = rangeEcho;
+    rangeEcho = 0;
+    T2CON = 0;                    // Stop and clear TF2/EXF2
+    TH2 = TL2 = 0;
+    T2CON = T2CON_CAPTURE;
+    ET2 = 1;
+    // Round trip, so half the path: mm = counts * 12 / FOSC_KHZ * 343 / 2
+    rangeMm = counts ? (uint16_t)(((uint32_t)counts * (RANGE_SOUND_MM_PER_MS * 12) + FOSC_KHZ)
+                                  / (2 * FOSC_KHZ))
+                     : PROTO_RANGE_NONE;
+    burst_fire(RANGE_CYCLES, rangeParams[1][0]);
+#if RANGE_SIM_ECHO_US
+    rangeSimPending = 1;
+#endif
+}
+
+void range_stop() {
+    ET2 = 0;
+    T2CON = 0;
+    rangeEcho = 0;
+    rangeMm = PROTO_RANGE_NONE;
+}
+
+#if RANGE_SIM_ECHO_US
+// Stands in for the receiver in the simulator: once the ping has played,
+// waits until Timer 2 reaches RANGE_SIM_ECHO_US and pulls T2EX low for two
+// machine cycles. Blocks the main loop for up to that long.
+void range_sim_echo() {
+    uint8_t hi, lo;
+
+    if(!rangeSimPending || burstToggles) return;
+    rangeSimPending = 0;
+    do {
+        do {
+            hi = TH2;
+            lo = TL2;
+        } while(hi != TH2);
+    } while(TR2 && (((uint16_t)hi << 8) | lo) < US_TO_T2(RANGE_SIM_ECHO_US));
+    T2EX = 0;
+    T2EX = 0;
+    T2EX = 1;
+}
+#endif
+#endif
+
+#if CALIBRATE_ENABLE
+/*----- Self-Calibration -----*/
+void cal_start() {
+#if RANGING_ENABLE
+    range_stop();                 // Timer 2 changes mode
+#endif
+    burstToggles = 0;
+    calLimit[0][0] = calLimit[0][1] = calLimit[1][0] = calLimit[1][1] = 0;
+    calDelay = CAL_FIRST_DELAY;
+    cal_gate_open();
+    calActive = 1;
+    tone_select();                // Measures the 8-bit path that normally plays
+}
+
+void cal_gate_open() {
+    T2CON = 0;
+    TH2 = TL2 = 0;
+    calGate = 0;
+    currentFreqDelay = calDelay;
+    toneCounter = toneCounter8 = 0;
+    T2CON = T2CON_COUNTER;
+}
+
+// Once per tick from TASK_PATTERN instead of the pattern
+void cal_tick() {
+    uint16_t hz;
+    uint8_t r;
+#if UART_ENABLE
+    uint8_t buf[3];
+#endif
+
+    if(++calGate < CAL_GATE_MS) return;
+    T2CON = 0;
+    hz = ((uint16_t)TH2 << 8) | TL2;
+    hz = hz > 0xFFFF / (1000 / CAL_GATE_MS) ? 0xFFFF : hz * (1000 / CAL_GATE_MS);
+    for(r=0; r<2; r++) {
+        // Zero counts means no loopback wire, which must not pass as a limit
+        if(!calLimit[r][0] && hz && hz <= rangeLabelHz[r][1]) calLimit[r][0] = calDelay;
+        if(hz >= rangeLabelHz[r][0]) calLimit[r][1] = calDelay;
+    }
+#if UART_ENABLE
+    buf[0] = calDelay;
+    buf[1] = hz >> 8;
+    buf[2] = hz & 0xFF;
+    send_frame(PROTO_RSP_CAL_POINT, buf, 3);
+#endif
+    if(++calDelay <= CAL_LAST_DELAY) cal_gate_open();
+    else cal_finish();
+}
+
+// Installs the limits of each range that was fully bracketed, the others
+// keep their values, then restarts the pattern
+void cal_finish() {
+    uint8_t r, ok = 0;
+#if UART_ENABLE
+    uint8_t buf[7];
+#endif
+
+    calActive = 0;
+    for(r=0; r<2; r++) {
+        if(!calLimit[r][0] || calLimit[r][1] <= calLimit[r][0]) continue;
+        rangeParams[r][0] = calLimit[r][0];
+        rangeParams[r][1] = calLimit[r][1];
+        rangeParams[r][2] = (calLimit[r][0] + calLimit[r][1]) / 2;
+        ok |= 1 << r;
+    }
+#if UART_ENABLE
+    buf[0] = ok;
+    for(r=0; r<6; r++) buf[1 + r] = rangeParams[r / 3][r % 3];
+    send_frame(PROTO_RSP_CAL_DONE, buf, 7);
+#endif
+    if(!hopCustom) hop_default_set();
+    currentFreqDelay = rangeParams[currentRange][2];
+    pattern_restart();
+    if(!isActive || dutyResting) output_park();
+}
+#endif
+
+#if RESONANCE_ENABLE
+/*----- Resonance Tracking -----*/
+// Reads AIN0 into resoLevel. Returns 0 while a journal record holds the bus;
+// an ADC that does not answer reads as 0. The tone stops for the ~0.2ms the
+// transfer takes, which the peak detector rides through.
+__bit adc_read() {
+#if EEPROM_ENABLE
+    if(journalState) return 0;
+#endif
+    resoLevel = 0;
+    i2c_start();
+    if(i2c_write(ADC_DEV) && i2c_write(ADC_CHANNEL)) {
+        i2c_start();              // Repeated start
+        i2c_write(ADC_DEV | 1);
+        i2c_read(1);              // Conversion from before the channel was set
+        resoLevel = i2c_read(0);
+    }
+    i2c_stop();
+    return 1;
+}
+
+// Without an ADC every level reads 0 and the range start delay is kept
+void reso_start() {
+    resoRange = currentRange;
+    resoPhase = RESO_SWEEP;
+    resoTimer = 0;
+    resoBest = rangeParams[currentRange][2];
+    resoBestLevel = 0;
+    currentFreqDelay = rangeParams[currentRange][1];
+}
+
+// Once per tick from update_sweep()
+void reso_tick() {
+    uint8_t minDelay = rangeParams[currentRange][0];
+    uint8_t maxDelay = rangeParams[currentRange][1];
+
+    if(resoRange != currentRange) reso_start();
+    resoTimer++;
+    if(resoPhase == RESO_LOCKED) {
+        if(resoTimer < RESO_TRACK_MS / speedSteps[currentSpeed]) return;
+        resoPhase = RESO_DITHER;
+        resoProbe = 0;
+        resoTimer = 0;
+        currentFreqDelay = resoBest > minDelay ? resoBest - 1 : resoBest;
+        return;
+    }
+    if(resoTimer < RESO_SETTLE_MS || !adc_read()) return;
+    resoTimer = 0;
+
+    if(resoPhase == RESO_SWEEP) {
+        if(resoLevel > resoBestLevel) {
+            resoBestLevel = resoLevel;
+            resoBest = currentFreqDelay;
+        }
+        if(currentFreqDelay > minDelay) {
+            currentFreqDelay--;
+            return;
+        }
+    } else {
+        resoProbeLevel[resoProbe] = resoLevel;
+        if(++resoProbe == 1) {
+            currentFreqDelay = resoBest < maxDelay ? resoBest + 1 : resoBest;
+            return;
+        }
+        if(resoProbe == 2) {
+            currentFreqDelay = resoBest;
+            return;
+        }
+        // Move towards the louder neighbour only if it beats the centre
+        resoBestLevel = resoProbeLevel[2];
+        if(resoProbeLevel[0] > resoBestLevel && resoProbeLevel[0] >= resoProbeLevel[1]
+           && resoBest > minDelay) {
+            resoBest--;
+            resoBestLevel = resoProbeLevel[0];
+        } else if(resoProbeLevel[1] > resoBestLevel && resoBest < maxDelay) {
+            resoBest++;
+            resoBestLevel = resoProbeLevel[1];
+        }
+    }
+    resoPhase = RESO_LOCKED;
+    currentFreqDelay = resoBest;
+}
+#endif
+
 /*----- Pattern Implementations -----*/
+// Moves currentFreqDelay by step, saturating at the limits of the current
+// range instead of wrapping. Returns 1 when it ends on the limit in the
+// direction of the step, which is where a sweep turns or restarts.
+__bit delay_step(int16_t step) {
+    uint16_t minDelay = rangeParams[currentRange][0];
+    uint16_t maxDelay = rangeParams[currentRange][1];
+    uint16_t delay = currentFreqDelay;
+
+    if(step < 0) delay = delay > minDelay + (uint16_t)-step ? delay + step : minDelay;
+    else delay = delay + (uint16_t)step < maxDelay ? delay + step : maxDelay;
+    // A delay left outside the range by another pattern comes back in
+    if(delay < minDelay) delay = minDelay;
+    if(delay > maxDelay) delay = maxDelay;
+    currentFreqDelay = delay;
+    return delay == (step < 0 ? minDelay : maxDelay);
+}
+
 void update_sweep() {
     uint16_t minDelay = rangeParams[currentRange][0];
     uint16_t maxDelay = rangeParams[currentRange][1];
@@ -196,18 +2258,30 @@ void update_sweep() {
     static uint8_t chirpState = 0;        // For chirps pattern
     static uint16_t chirpCount = 0;       // For chirps pattern
     static uint16_t walkCount = 0;        // For random walk pattern
+    static uint8_t hopCount = 0;          // For hopping pattern
+    static uint16_t gapCount = 0;         // For burst and ranging patterns
+    uint8_t i;
+
+    if(patternStart) {                    // First step after set_pattern()
+        patternStart = 0;
+        pulseCount = stepCount = hbCount = sirenCount = chirpCount = walkCount = 0;
+        chirpState = 0;
+        hopCount = 0;
+        // First burst or ping right away
+        gapCount = currentPattern == RANGE_PATTERN ? RANGE_PERIOD_MS : burstGap;
+    }
     
     switch(currentPattern) {
         case 0: // Up Sweep
             if(currentFreqDelay > minDelay) 
-                currentFreqDelay -= speedSteps[currentSpeed];
+                delay_step(-speedSteps[currentSpeed]);
             else 
                 currentFreqDelay = maxDelay;
             break;
             
         case 1: // Down Sweep
             if(currentFreqDelay < maxDelay) 
-                currentFreqDelay += speedSteps[currentSpeed];
+                delay_step(speedSteps[currentSpeed]);
             else 
                 currentFreqDelay = minDelay;
             break;
@@ -215,12 +2289,12 @@ void update_sweep() {
         case 2: // Zig-Zag
             if(sweepDirection) {
                 if(currentFreqDelay < maxDelay) 
-                    currentFreqDelay += speedSteps[currentSpeed];
+                    delay_step(speedSteps[currentSpeed]);
                 else 
                     sweepDirection = 0;
             } else {
                 if(currentFreqDelay > minDelay) 
-                    currentFreqDelay -= speedSteps[currentSpeed];
+                    delay_step(-speedSteps[currentSpeed]);
                 else 
                     sweepDirection = 1;
             }
@@ -231,9 +2305,9 @@ void update_sweep() {
                 currentFreqDelay = minDelay + (simple_rand() % (maxDelay-minDelay+1));
             break;
             
-        case 4: // Pulse
+        case PATTERN_PULSE: // 50ms note every 500ms
+            if(pulseCount == 0) envelope_trigger(ENV_RAMP_MS, 50 - 2 * ENV_RAMP_MS, ENV_RAMP_MS);
             if(++pulseCount >= 500) pulseCount = 0;
-            BUZZER = (pulseCount < 50); // 10% duty cycle
             break;
             
         case 5: // Stepped
@@ -246,22 +2320,19 @@ void update_sweep() {
             break;
             
         case 6: // Triangle
-            currentFreqDelay += freqStep * speedSteps[currentSpeed];
-            if(currentFreqDelay <= minDelay || currentFreqDelay >= maxDelay)
+            if(delay_step(freqStep * speedSteps[currentSpeed]))
                 freqStep = -freqStep;
             break;
             
-        case 7: // Heartbeat
-            if(++hbCount >= 600) hbCount = 0;
-            
-            if(hbCount < 100)       // First beat
+        case PATTERN_HEARTBEAT: // Two 100ms beats, gate shut in between
+            if(hbCount == 0) {              // First beat
                 currentFreqDelay = minDelay + 2;
-            else if(hbCount < 150)  // First pause
-                currentFreqDelay = maxDelay;
-            else if(hbCount < 250)  // Second beat
+                envelope_trigger(ENV_RAMP_MS, 100 - 2 * ENV_RAMP_MS, ENV_RAMP_MS);
+            } else if(hbCount == 150) {     // Second beat after a 50ms pause
                 currentFreqDelay = minDelay + 1;
-            else                    // Second pause
-                currentFreqDelay = maxDelay;
+                envelope_trigger(ENV_RAMP_MS, 100 - 2 * ENV_RAMP_MS, ENV_RAMP_MS);
+            }
+            if(++hbCount >= 600) hbCount = 0;
             break;
             
         case 8: // Siren
@@ -274,7 +2345,7 @@ void update_sweep() {
         case 9: // Chirps
             if(chirpState == 0) {
                 if(currentFreqDelay > minDelay)
-                    currentFreqDelay -= speedSteps[currentSpeed]*3;
+                    delay_step(-speedSteps[currentSpeed]*3);
                 else
                     chirpState = 1;
             } else if(++chirpCount > 300) {
@@ -287,58 +2358,133 @@ void update_sweep() {
         case 10: // Random Walk
             if(++walkCount >= 20) {
                 walkCount = 0;
-                currentFreqDelay += (simple_rand() % 5) - 2;
-                if(currentFreqDelay < minDelay) currentFreqDelay = minDelay;
-                if(currentFreqDelay > maxDelay) currentFreqDelay = maxDelay;
+                delay_step((int8_t)(simple_rand() % 5) - 2);
+            }
+            break;
+            
+        case HOP_PATTERN: // Frequency hopping, one table lookup per hop
+            if(++hopCount >= hopPeriod / speedSteps[currentSpeed]) {
+                hopCount = 0;
+                for(i=0; i<HOP_LFSR_STEPS; i++) {
+                    if(hopLfsr & 1) hopLfsr = (hopLfsr >> 1) ^ HOP_LFSR_TAPS;
+                    else hopLfsr >>= 1;
+                }
+                currentFreqDelay = hopSet[hopLfsr & (HOP_SET_SIZE - 1)];
+            }
+            break;
+
+        case BURST_PATTERN: // burstCycles periods, then burstGap ms from the end of the burst
+            if(burstToggles) break;
+            if(++gapCount >= burstGap) {
+                gapCount = 0;
+                burst_fire(burstCycles, burstDelay);
+            }
+            break;
+
+#if RESONANCE_ENABLE
+        case RESO_PATTERN: // Sweep, then dither around the loudest delay
+            reso_tick();
+            break;
+#endif
+
+#if RANGING_ENABLE
+        case RANGE_PATTERN: // One ping every RANGE_PERIOD_MS from its start
+            if(++gapCount >= RANGE_PERIOD_MS) {
+                gapCount = 0;
+                range_ping();
+            }
+#if RANGE_SIM_ECHO_US
+            range_sim_echo();
+#endif
+            break;
+#endif
+
+        case USER_PATTERN: // Uploaded table, timed by the 1ms tick
+            if(!userTableValid) break;
+            if(nowMs - userPointStart >= userTable[userIndex].dwell) {
+                userPointStart = nowMs;
+                if(++userIndex >= userTableCount) userIndex = 0;
+                currentFreqDelay = userTable[userIndex].delay;
             }
             break;
     }
 }
 
 /*----- Main Program -----*/
-void main() {
+// Everything main() does before its loop; also the entry point of the host
+// model (host/fwmodel.c)
+void system_init() {
+#if WATCHDOG_ENABLE
+    if(warmStart) warm_resume();  // Before any ISR sees the leftover RAM
+#endif
+
     // Initialize hardware
-    P0 = P1 = P2 = P3 = 0xFF; // All LEDs off (active low)
+    // Ports leave reset at 0xFF, so the LEDs are already off and the buttons
+    // readable; writing P1/P3 again would unpark the buzzer pins
+    P0 = P2 = 0xFF;
     TMOD = 0x01;               // Timer 0 mode 1
-    TH0 = 0xFC; TL0 = 0x66;    // 1ms timer @12MHz
+    TH0 = T0_RELOAD >> 8;      // 1ms timer
+    TL0 = (uint8_t)T0_RELOAD;
     ET0 = 1;                   // Enable Timer 0 interrupt
     TR0 = 1;                   // Start Timer 0
+    IT0 = IT1 = 1;             // Buttons on INT0/INT1, falling edge
+    EX0 = EX1 = 1;
+#if UART_ENABLE
+    uart_init();               // Serial link on Timer 1
+#endif
     EA = 1;                    // Enable global interrupts
     
     // Initial state
-    currentRange = 0;
+#if WATCHDOG_ENABLE
+    if(!warmStart)             // Otherwise warm_resume() already set it
+#endif
+    {
+        currentRange = 0;
+#if EEPROM_ENABLE
+        settings_restore();    // Last saved power/pattern/speed/range
+#endif
+    }
+#if SCHEDULE_ENABLE
+    schedule_restart();
+#endif
+    if(!hopCustom) hop_default_set();  // A warm restart keeps a host-supplied set
     currentFreqDelay = rangeParams[currentRange][2];
+    pattern_restart();         // Starts a restored pattern as set_pattern() would;
+                               // also sets BUZZER_COMP for the first edge
     updateStatusLEDs();
-    
-    // Main loop
-    while(1) {
-        // Check buttons
-        if(checkButton_PWR()) {
-            isActive = !isActive;
-            if(!isActive) BUZZER = 0;
-            updateStatusLEDs();
-        }
-        
-        if(checkButton_PAT()) {
-            if(++currentPattern >= 11) currentPattern = 0;
-            updateStatusLEDs();
-        }
-        
-        if(checkButton_SPD()) {
-            if(++currentSpeed >= 5) currentSpeed = 0;
-            updateStatusLEDs();
-        }
-        
-        if(checkButton_RNG()) {
-            currentRange = !currentRange;
-            currentFreqDelay = rangeParams[currentRange][2];
-            updateStatusLEDs();
-        }
-        
-        // Generate sound if active
-        if(isActive) {
-            generate_tone();
-            update_sweep();
-        }
-    }
+#if WATCHDOG_ENABLE
+    warm_save();
+    wdt_feed();                // Starts the watchdog
+#endif
+#if CALIBRATE_ENABLE && CALIBRATE_AT_BOOT
+#if WATCHDOG_ENABLE
+    if(!warmStart)             // A warm restart kept the calibrated table
+#endif
+        cal_start();
+#endif
+}
+
+// One pass of the main loop; the host model steps the firmware with it.
+// Static inline, so the loop around the tone path pays no call and return
+// and no external copy is needed (C99 6.7.4).
+static inline void main_pass() {
+    // Button edges and serial bytes arrive as events, periodic work as tasks
+    if(evTail != evHead) dispatch_events();
+    if(schedTick != tickCount) scheduler_run();
+#if UART_ENABLE
+    loopCount++;
+#endif
+
+    // Generate sound, or sleep until the next tick once there is no sound,
+    // no event and no due task left
+#if POWER_SAVE_ENABLE
+    if(!tone_step() && schedTick == tickCount && evTail == evHead) power_save();
+#else
+    tone_step();
+#endif
+}
+
+void main() {
+    system_init();
+    while(1) main_pass();
 }
\ No newline at end of file
@@ -5,6 +5,10 @@
 
 #include <reg52.h>
 #include <intrins.h>
+#include "board.h"
+
+#define T0_RELOAD (65536 - T0_COUNTS_PER_MS)
+#define DELAY_LOOPS_PER_MS FOSC_SCALE(120)
 
 /*----- Hardware Connections -----*/
 // Status LEDs (active low)
@@ -28,9 +32,9 @@ sbit CHIRP_LED   = P2^3;  // Green
 sbit WALK_LED    = P2^4;  // Yellow
 
 
-// Audio outputs
-sbit BUZZER = P1^2;       // Main buzzer output
-sbit BUZZER_INV = P1^3;   // Inverted buzzer output 
+// Audio outputs, from the BOARD profile in board.h
+BOARD_SBIT(BUZZER, BUZZER_PORT, BUZZER_BIT);                // Main buzzer output
+BOARD_SBIT(BUZZER_INV, BUZZER_COMP_PORT, BUZZER_COMP_BIT);  // Inverted buzzer output
 
 // Buzzer and buttons
 sbit BTN_POWER   = P3^2;  // Power button
@@ -50,8 +54,8 @@ unsigned int currentFreqDelay;    // Current delay value
 
 // Frequency range parameters [min, max, initial]
 const unsigned int rangeParams[2][3] = {
-    {25, 50, 37},  // 5-10kHz range
-    {9, 18, 13}    // 18-27kHz range
+    {FOSC_SCALE(25), FOSC_SCALE(50), FOSC_SCALE(37)},  // 5-10kHz range
+    {FOSC_SCALE(9), FOSC_SCALE(18), FOSC_SCALE(13)}    // 18-27kHz range
 };
 
 // Speed multipliers
@@ -73,13 +77,13 @@ unsigned char simple_rand(void);
 void delay_ms(unsigned int ms) {
     unsigned int i, j;
     for(i=0; i<ms; i++)
-        for(j=0; j<120; j++);  // ~1ms at 12MHz
+        for(j=0; j<DELAY_LOOPS_PER_MS; j++);  // ~1ms
 }
 
 /*----- Timer 0 ISR -----*/
 void Timer0_ISR() interrupt 1 {
     static unsigned int msCount = 0;
-    TH0 = 0xFC; TL0 = 0x66;  // Reload for 1ms
+    TH0 = T0_RELOAD >> 8; TL0 = T0_RELOAD & 0xFF;  // Reload for 1ms
     
     if(isActive) {
         if(++msCount >= 100) {  // 5Hz blink
@@ -299,7 +303,7 @@ void main() {
     // Initialize hardware
     P0 = P1 = P2 = P3 = 0xFF; // All LEDs off (active hige)
     TMOD = 0x01;               // Timer 0 mode 1
-    TH0 = 0xFC; TL0 = 0x66;    // 1ms timer @12MHz
+    TH0 = T0_RELOAD >> 8; TL0 = T0_RELOAD & 0xFF;  // 1ms timer
     ET0 = TR0 = EA = 1;        // Enable timer and interrupts
     
 	  BUZZER = 0;
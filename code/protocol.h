@@ -0,0 +1,99 @@
+/**
+ * AT89S52 Buzzer Controller - Serial Protocol
+ * Shared by the firmware and the host tools (host/buzzerctl.c)
+ *
+ * Frame layout (all multi-byte values big-endian):
+ *   SYNC | CMD | LEN | PAYLOAD[LEN] | CRC8
+ * CRC8 uses polynomial 0x07, initial value 0, over CMD, LEN and PAYLOAD.
+ *
+ * Pattern table upload: TABLE_BEGIN, one or more TABLE_DATA frames, then
+ * TABLE_COMMIT carrying a CRC16-CCITT (poly 0x1021, init 0xFFFF) over all
+ * points as sent (delayH, delayL, dwellH, dwellL per point).
+ */
+
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#define PROTO_SYNC          0xA5
+#define PROTO_MAX_PAYLOAD   16
+#define PROTO_CRC_POLY      0x07
+
+/*----- Host -> Firmware Commands -----*/
+#define PROTO_CMD_PING          0x01  // No payload, answered with ACK
+#define PROTO_CMD_GET_STATUS    0x02  // No payload, answered with STATUS
+#define PROTO_CMD_SET_POWER     0x10  // [0=off, 1=on]
+#define PROTO_CMD_SET_PATTERN   0x11  // [pattern 0-10 or one of the PROTO_*_PATTERN slots]
+#define PROTO_CMD_SET_SPEED     0x12  // [speed 0-4]
+#define PROTO_CMD_SET_RANGE     0x13  // [0=5-10kHz, 1=18-27kHz]
+#define PROTO_CMD_TELEMETRY     0x14  // [period in 10ms units, 0=off or PROTO_TELEMETRY_MIN_PERIOD up]
+#define PROTO_CMD_SET_SCHEDULE  0x15  // [autoOffH, autoOffL, onH, onL, offH, offL] seconds, 0=disabled
+#define PROTO_CMD_SET_VOICE2    0x16  // [mode, valueH, valueL], see Second Voice
+#define PROTO_CMD_SET_HOP       0x17  // [period ms] or [period ms, PROTO_HOP_SET_SIZE delays]
+#define PROTO_CMD_SET_BURST     0x18  // [cycles, delayH, delayL, gapH, gapL] gap in ms
+#define PROTO_CMD_CALIBRATE     0x19  // No payload, answered with ACK, CAL_POINTs, CAL_DONE
+#define PROTO_CMD_TABLE_BEGIN   0x20  // [point count]
+#define PROTO_CMD_TABLE_DATA    0x21  // [first index, up to 3 x (delayH, delayL, dwellH, dwellL)]
+#define PROTO_CMD_TABLE_COMMIT  0x22  // [crcH, crcL]
+
+/*----- Firmware -> Host Responses -----*/
+#define PROTO_RSP_ACK           0x80  // [cmd]
+#define PROTO_RSP_NAK           0x81  // [cmd, error]
+#define PROTO_RSP_STATUS        0x82  // [flags, pattern, speed, delayH, delayL]
+#define PROTO_RSP_TELEMETRY     0x83  // [seq, flags, pattern, speed, delayH, delayL, loopsH, loopsL,
+                                      //  idleH, idleL, eventOverflows, rxOverruns, warmRestarts,
+                                      //  rangeH, rangeL, resonanceLevel]
+#define PROTO_RSP_CAL_POINT     0x84  // [delay, hzH, hzL] measured on the loopback
+#define PROTO_RSP_CAL_DONE      0x85  // [ok range mask, min0, max0, start0, min1, max1, start1]
+
+/*----- Status Flags -----*/
+#define PROTO_FLAG_ACTIVE       0x01
+#define PROTO_FLAG_RANGE        0x02
+#define PROTO_FLAG_RESTING      0x04  // Off phase of the duty schedule
+#define PROTO_FLAG_VOICE2       0x08  // BUZZER_COMP plays its own voice
+#define PROTO_FLAG_CALIBRATING  0x10  // Self-calibration running
+
+/*----- NAK Error Codes -----*/
+#define PROTO_ERR_CRC           0x01  // Frame checksum mismatch
+#define PROTO_ERR_LEN           0x02  // Payload length wrong for command
+#define PROTO_ERR_ARG           0x03  // Argument out of range
+#define PROTO_ERR_CMD           0x04  // Unknown command
+#define PROTO_ERR_STATE         0x05  // Not allowed now (e.g. no valid table)
+
+/*----- Second Voice -----*/
+#define PROTO_VOICE2_OFF        0     // BUZZER_COMP is the inverse of BUZZER
+#define PROTO_VOICE2_CARRIER    1     // Fixed delay value on BUZZER_COMP
+#define PROTO_VOICE2_DETUNE     2     // Pattern delay plus a signed offset (beats)
+#define PROTO_VOICE2_MIN_DETUNE (-8)  // Most negative offset; the result never drops below 1
+
+/*----- Frequency Hopping -----*/
+#define PROTO_HOP_PATTERN       11    // Pattern slot of the hopping engine
+#define PROTO_HOP_SET_SIZE      8     // Delays in a hop set, 1-255 each
+
+/*----- Tone Bursts -----*/
+#define PROTO_BURST_PATTERN     13    // Exactly N carrier cycles, then a gap
+
+/*----- Echo Ranging -----*/
+#define PROTO_RANGE_PATTERN     14    // Pings and times the echo on T2EX
+#define PROTO_RANGE_NONE        0xFFFF  // Telemetry range: no echo or not ranging, else mm
+
+/*----- Resonance Tracking -----*/
+#define PROTO_RESO_PATTERN      15    // Locks onto the loudest delay and follows it
+
+/*----- Pattern Table -----*/
+#define PROTO_USER_PATTERN      12    // Pattern slot that plays the uploaded table
+#define PROTO_TABLE_CHUNK       3     // Points per TABLE_DATA frame
+#define PROTO_CRC16_POLY        0x1021
+#define PROTO_CRC16_INIT        0xFFFF
+
+/*----- Defaults -----*/
+#define PROTO_BAUD              4800  // Timer 1 mode 2, SMOD=1 @12MHz
+
+/*----- Telemetry -----*/
+#define PROTO_TELEMETRY_LEN     16    // PROTO_RSP_TELEMETRY payload bytes
+// Shortest period, in 10ms units, that still fits one whole frame (sync,
+// cmd, len, payload, crc at 10 bits per byte) on the wire: 20 bytes take
+// 41.7ms at 4800 baud, so 5 (50ms)
+#define PROTO_TELEMETRY_MIN_PERIOD \
+    (((PROTO_TELEMETRY_LEN + 4) * 10UL * 100 + PROTO_BAUD - 1) / PROTO_BAUD)
+
+#endif
@@ -0,0 +1,555 @@
+/**
+ * AT89S52 Buzzer Controller - Linux Host Tool
+ * Drives the firmware serial protocol (code/protocol.h) over a real
+ * serial adapter (/dev/ttyUSB0) or a simulator pseudo-terminal.
+ *
+ * Build: cc -O2 -Wall -I../code -o buzzerctl buzzerctl.c
+ */
+
+#define _DEFAULT_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "protocol.h"
+
+#define DEFAULT_DEVICE  "/dev/ttyUSB0"
+#define DEFAULT_TIMEOUT 500   // ms to wait for a reply frame
+#define MAX_TABLE_POINTS 255
+
+typedef struct {
+    uint8_t cmd;
+    uint8_t len;
+    uint8_t payload[PROTO_MAX_PAYLOAD];
+} frame_t;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+/*----- Serial Port -----*/
+static speed_t baud_to_speed(long baud) {
+    switch(baud) {
+        case 1200:   return B1200;
+        case 2400:   return B2400;
+        case 4800:   return B4800;
+        case 9600:   return B9600;
+        case 19200:  return B19200;
+        case 38400:  return B38400;
+        case 57600:  return B57600;
+        case 115200: return B115200;
+        default:     return 0;
+    }
+}
+
+static int port_open(const char *path, long baud) {
+    struct termios tio;
+    speed_t speed = baud_to_speed(baud);
+    int fd;
+
+    if(!speed) {
+        fprintf(stderr, "unsupported baud rate %ld\n", baud);
+        return -1;
+    }
+    fd = open(path, O_RDWR | O_NOCTTY);
+    if(fd < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    // A pty from the simulator accepts the same settings as a real UART
+    if(tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, speed);
+        cfsetospeed(&tio, speed);
+        tio.c_cflag |= CLOCAL | CREAD;
+        tio.c_cc[VMIN] = 0;
+        tio.c_cc[VTIME] = 0;
+        tcsetattr(fd, TCSANOW, &tio);
+        tcflush(fd, TCIOFLUSH);
+    }
+    return fd;
+}
+
+static int write_all(int fd, const uint8_t *buf, size_t len) {
+    while(len) {
+        ssize_t n = write(fd, buf, len);
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/*----- Framing -----*/
+static uint8_t crc8_update(uint8_t crc, uint8_t b) {
+    int i;
+    crc ^= b;
+    for(i=0; i<8; i++)
+        crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ PROTO_CRC_POLY) : (uint8_t)(crc << 1);
+    return crc;
+}
+
+static int send_frame(int fd, uint8_t cmd, const uint8_t *payload, uint8_t len) {
+    uint8_t buf[PROTO_MAX_PAYLOAD + 4];
+    uint8_t crc = crc8_update(crc8_update(0, cmd), len);
+    int i;
+
+    buf[0] = PROTO_SYNC;
+    buf[1] = cmd;
+    buf[2] = len;
+    for(i=0; i<len; i++) {
+        buf[3 + i] = payload[i];
+        crc = crc8_update(crc, payload[i]);
+    }
+    buf[3 + len] = crc;
+    return write_all(fd, buf, (size_t)len + 4);
+}
+
+static uint16_t crc16_update(uint16_t crc, uint8_t b) {
+    int i;
+    crc ^= (uint16_t)b << 8;
+    for(i=0; i<8; i++)
+        crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ PROTO_CRC16_POLY) : (uint16_t)(crc << 1);
+    return crc;
+}
+
+static int64_t now_ms(clockid_t clk) {
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Returns 1 when a frame arrived, 0 on timeout, -1 on error
+static int recv_frame(int fd, frame_t *f, int timeoutMs) {
+    int state = 0;
+    uint8_t idx = 0, crc = 0;
+    int64_t deadline = now_ms(CLOCK_MONOTONIC) + timeoutMs;
+    uint8_t c;
+
+    for(;;) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        int remaining = (int)(deadline - now_ms(CLOCK_MONOTONIC));
+        ssize_t n;
+
+        if(stopRequested) return 0;
+        if(remaining < 0) remaining = 0;
+        n = poll(&pfd, 1, remaining);
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            return -1;
+        }
+        if(n == 0) return 0;
+        n = read(fd, &c, 1);
+        if(n < 0) {
+            if(errno == EINTR || errno == EAGAIN) continue;
+            return -1;
+        }
+        if(n == 0) continue;
+
+        switch(state) {
+            case 0:
+                if(c == PROTO_SYNC) state = 1;
+                break;
+            case 1:
+                f->cmd = c;
+                crc = crc8_update(0, c);
+                state = 2;
+                break;
+            case 2:
+                f->len = c;
+                crc = crc8_update(crc, c);
+                idx = 0;
+                if(c > PROTO_MAX_PAYLOAD) state = 0;
+                else state = c ? 3 : 4;
+                break;
+            case 3:
+                f->payload[idx++] = c;
+                crc = crc8_update(crc, c);
+                if(idx >= f->len) state = 4;
+                break;
+            case 4:
+                state = 0;
+                if(c == crc) return 1;
+                fprintf(stderr, "dropped frame 0x%02X with bad CRC\n", f->cmd);
+                break;
+        }
+    }
+}
+
+// Sends a command and waits for its ACK/NAK (or STATUS for GET_STATUS)
+static int transact(int fd, uint8_t cmd, const uint8_t *arg, uint8_t len,
+                    frame_t *reply, int timeoutMs) {
+    if(send_frame(fd, cmd, arg, len) < 0) {
+        perror("write");
+        return -1;
+    }
+    for(;;) {
+        int r = recv_frame(fd, reply, timeoutMs);
+        if(r <= 0) {
+            if(r == 0) fprintf(stderr, "timeout waiting for reply to 0x%02X\n", cmd);
+            return -1;
+        }
+        if(reply->cmd == PROTO_RSP_NAK && reply->len == 2 && reply->payload[0] == cmd) {
+            fprintf(stderr, "command 0x%02X rejected, error %u\n", cmd, reply->payload[1]);
+            return -1;
+        }
+        if(reply->cmd == PROTO_RSP_ACK && reply->len >= 1 && reply->payload[0] == cmd)
+            return 0;
+        if(cmd == PROTO_CMD_GET_STATUS && reply->cmd == PROTO_RSP_STATUS && reply->len == 5)
+            return 0;
+        // Anything else (e.g. telemetry still streaming) is skipped
+    }
+}
+
+/*----- Commands -----*/
+static int cmd_status(int fd, int timeoutMs) {
+    frame_t f;
+    if(transact(fd, PROTO_CMD_GET_STATUS, NULL, 0, &f, timeoutMs) < 0) return -1;
+    printf("power:   %s%s\n", (f.payload[0] & PROTO_FLAG_ACTIVE) ? "on" : "off",
+           (f.payload[0] & PROTO_FLAG_RESTING) ? " (resting)" : "");
+    printf("range:   %u\n", (f.payload[0] & PROTO_FLAG_RANGE) ? 1 : 0);
+    printf("pattern: %u\n", f.payload[1]);
+    printf("speed:   %u\n", f.payload[2]);
+    printf("delay:   %u\n", (f.payload[3] << 8) | f.payload[4]);
+    printf("voice2:  %s\n", (f.payload[0] & PROTO_FLAG_VOICE2) ? "on" : "off");
+    if(f.payload[0] & PROTO_FLAG_CALIBRATING) printf("calibrating\n");
+    return 0;
+}
+
+// Starts the loopback self-calibration and prints each measured delay value
+// and the resulting range limits
+static int cmd_calibrate(int fd, int timeoutMs) {
+    frame_t f;
+    int r, i;
+
+    if(transact(fd, PROTO_CMD_CALIBRATE, NULL, 0, &f, timeoutMs) < 0) return -1;
+    printf("delay      hz\n");
+    for(;;) {
+        r = recv_frame(fd, &f, timeoutMs);
+        if(r <= 0) {
+            if(r == 0) fprintf(stderr, "calibration stalled\n");
+            return -1;
+        }
+        if(f.cmd == PROTO_RSP_CAL_POINT && f.len == 3)
+            printf("%5u %7u\n", f.payload[0], (f.payload[1] << 8) | f.payload[2]);
+        if(f.cmd == PROTO_RSP_CAL_DONE && f.len == 7) break;
+    }
+    for(i=0; i<2; i++)
+        printf("range %d: min %u, max %u, start %u%s\n", i, f.payload[1 + i * 3],
+               f.payload[2 + i * 3], f.payload[3 + i * 3],
+               (f.payload[0] & (1 << i)) ? "" : " (not calibrated, kept)");
+    return (f.payload[0] & 3) == 3 ? 0 : -1;
+}
+
+// voice2 off | carrier DELAY | detune OFFSET
+static int cmd_voice2(int fd, int argc, char **argv, int timeoutMs) {
+    uint8_t arg[3] = { PROTO_VOICE2_OFF, 0, 0 };
+    frame_t f;
+    char *end;
+    long v = 0;
+
+    if(strcmp(argv[0], "off") != 0) {
+        if(argc < 2) {
+            fprintf(stderr, "voice2 %s needs a value\n", argv[0]);
+            return -1;
+        }
+        v = strtol(argv[1], &end, 0);
+        if(!strcmp(argv[0], "carrier") && *end == '\0' && v >= 1 && v <= 0xFFFF) {
+            arg[0] = PROTO_VOICE2_CARRIER;
+        } else if(!strcmp(argv[0], "detune") && *end == '\0' &&
+                  v >= PROTO_VOICE2_MIN_DETUNE && v <= 0x7FFF) {
+            arg[0] = PROTO_VOICE2_DETUNE;
+        } else {
+            fprintf(stderr, "invalid voice2 setting '%s %s'\n", argv[0], argv[1]);
+            return -1;
+        }
+    }
+    arg[1] = (uint8_t)((uint16_t)v >> 8);
+    arg[2] = (uint8_t)v;
+    return transact(fd, PROTO_CMD_SET_VOICE2, arg, 3, &f, timeoutMs);
+}
+
+// Table file: one "delay dwell_ms" pair per line, '#' starts a comment
+static int cmd_upload(int fd, const char *path, int timeoutMs) {
+    static uint8_t points[MAX_TABLE_POINTS * 4];
+    char line[128];
+    FILE *in = fopen(path, "r");
+    uint16_t crc = PROTO_CRC16_INIT;
+    uint8_t count = 0, crcBytes[2], chunk[1 + PROTO_TABLE_CHUNK * 4];
+    int lineNo = 0, i, n;
+    frame_t f;
+
+    if(!in) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    while(fgets(line, sizeof(line), in)) {
+        unsigned long delay, dwell;
+        char *hash = strchr(line, '#');
+        lineNo++;
+        if(hash) *hash = '\0';
+        n = sscanf(line, "%lu %lu", &delay, &dwell);
+        if(n <= 0) continue;
+        if(n != 2 || !delay || !dwell || delay > 0xFFFF || dwell > 0xFFFF) {
+            fprintf(stderr, "%s:%d: expected \"delay dwell_ms\" (1-65535)\n", path, lineNo);
+            fclose(in);
+            return -1;
+        }
+        if(count == MAX_TABLE_POINTS) {
+            fprintf(stderr, "%s: more than %d points\n", path, MAX_TABLE_POINTS);
+            fclose(in);
+            return -1;
+        }
+        points[count * 4 + 0] = (uint8_t)(delay >> 8);
+        points[count * 4 + 1] = (uint8_t)delay;
+        points[count * 4 + 2] = (uint8_t)(dwell >> 8);
+        points[count * 4 + 3] = (uint8_t)dwell;
+        count++;
+    }
+    fclose(in);
+    if(!count) {
+        fprintf(stderr, "%s: no points\n", path);
+        return -1;
+    }
+
+    if(transact(fd, PROTO_CMD_TABLE_BEGIN, &count, 1, &f, timeoutMs) < 0) return -1;
+    for(i=0; i<count; i += PROTO_TABLE_CHUNK) {
+        n = count - i < PROTO_TABLE_CHUNK ? count - i : PROTO_TABLE_CHUNK;
+        chunk[0] = (uint8_t)i;
+        memcpy(chunk + 1, points + i * 4, (size_t)n * 4);
+        if(transact(fd, PROTO_CMD_TABLE_DATA, chunk, (uint8_t)(1 + n * 4), &f, timeoutMs) < 0)
+            return -1;
+    }
+    for(i=0; i<count * 4; i++)
+        crc = crc16_update(crc, points[i]);
+    crcBytes[0] = (uint8_t)(crc >> 8);
+    crcBytes[1] = (uint8_t)crc;
+    if(transact(fd, PROTO_CMD_TABLE_COMMIT, crcBytes, 2, &f, timeoutMs) < 0) return -1;
+    printf("uploaded %u points, crc 0x%04X; select with \"pattern %d\"\n",
+           count, crc, PROTO_USER_PATTERN);
+    return 0;
+}
+
+static void on_signal(int sig) {
+    (void)sig;
+    stopRequested = 1;
+}
+
+static int cmd_log(int fd, const char *path, int periodMs, int seconds, int timeoutMs) {
+    FILE *out = stdout;
+    frame_t f;
+    uint8_t period = (uint8_t)((periodMs + 9) / 10);
+    int64_t endMs = seconds > 0 ? now_ms(CLOCK_MONOTONIC) + (int64_t)seconds * 1000 : 0;
+    long rows = 0;
+    unsigned idle, range;
+    char rangeText[8];
+    int minMs = (int)PROTO_TELEMETRY_MIN_PERIOD * 10;
+
+    if(periodMs < minMs || periodMs > 2550) {
+        fprintf(stderr, "telemetry period must be %d-2550 ms\n", minMs);
+        return -1;
+    }
+    if(strcmp(path, "-") != 0) {
+        out = fopen(path, "w");
+        if(!out) {
+            fprintf(stderr, "%s: %s\n", path, strerror(errno));
+            return -1;
+        }
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    if(transact(fd, PROTO_CMD_TELEMETRY, &period, 1, &f, timeoutMs) < 0) {
+        if(out != stdout) fclose(out);
+        return -1;
+    }
+
+    fprintf(out, "host_time_ms,seq,active,range,pattern,speed,freq_delay,loops_per_period,idle_ticks,idle_pct,event_overflows,rx_overruns,warm_restarts,range_mm,resonance_level\n");
+    while(!stopRequested && (!endMs || now_ms(CLOCK_MONOTONIC) < endMs)) {
+        int r = recv_frame(fd, &f, periodMs * 4 + timeoutMs);
+        if(r < 0) break;
+        if(r == 0) {
+            if(!stopRequested) fprintf(stderr, "telemetry stalled\n");
+            continue;
+        }
+        if(f.cmd != PROTO_RSP_TELEMETRY || f.len != PROTO_TELEMETRY_LEN) continue;
+        idle = (f.payload[8] << 8) | f.payload[9];
+        range = (f.payload[13] << 8) | f.payload[14];
+        if(range == PROTO_RANGE_NONE) rangeText[0] = '\0';   // Empty cell: no echo
+        else snprintf(rangeText, sizeof rangeText, "%u", range);
+        fprintf(out, "%lld,%u,%u,%u,%u,%u,%u,%u,%u,%.1f,%u,%u,%u,%s,%u\n",
+                (long long)now_ms(CLOCK_REALTIME), f.payload[0],
+                (f.payload[1] & PROTO_FLAG_ACTIVE) ? 1 : 0,
+                (f.payload[1] & PROTO_FLAG_RANGE) ? 1 : 0,
+                f.payload[2], f.payload[3],
+                (f.payload[4] << 8) | f.payload[5],
+                (f.payload[6] << 8) | f.payload[7],
+                idle, idle * 100.0 / (period * 10), f.payload[10], f.payload[11],
+                f.payload[12], rangeText, f.payload[15]);
+        fflush(out);
+        rows++;
+    }
+
+    // Stop the stream so the next invocation starts from a quiet link
+    stopRequested = 0;
+    period = 0;
+    transact(fd, PROTO_CMD_TELEMETRY, &period, 1, &f, timeoutMs);
+    if(out != stdout) fclose(out);
+    fprintf(stderr, "%ld telemetry rows recorded\n", rows);
+    return 0;
+}
+
+static int parse_u16(const char *s, uint8_t *out) {
+    char *end;
+    unsigned long v = strtoul(s, &end, 0);
+    if(*s == '\0' || *end != '\0' || v > 0xFFFF) {
+        fprintf(stderr, "invalid value '%s' (0-65535)\n", s);
+        return -1;
+    }
+    out[0] = (uint8_t)(v >> 8);
+    out[1] = (uint8_t)v;
+    return 0;
+}
+
+static int parse_u8(const char *s, unsigned max, uint8_t *out) {
+    char *end;
+    unsigned long v = strtoul(s, &end, 0);
+    if(*s == '\0' || *end != '\0' || v > max) {
+        fprintf(stderr, "invalid value '%s' (0-%u)\n", s, max);
+        return -1;
+    }
+    *out = (uint8_t)v;
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+        "usage: %s [-d device] [-b baud] [-t timeout_ms] command [args]\n"
+        "\n"
+        "commands:\n"
+        "  ping                        check the link\n"
+        "  status                      print power, pattern, speed and range\n"
+        "  power on|off\n"
+        "  pattern N                   0-10, 11 = hopping, 12 = uploaded table,\n"
+        "                              13 = bursts, 14 = echo ranging,\n"
+        "                              15 = resonance tracking\n"
+        "  speed N                     0-4\n"
+        "  range N                     0=5-10kHz, 1=18-27kHz\n"
+        "  log FILE [period_ms] [sec]  record telemetry to CSV (FILE '-' = stdout)\n"
+        "  upload FILE                 upload a \"delay dwell_ms\" table for pattern 12\n"
+        "  schedule OFF_S [ON_S REST_S] auto-off after OFF_S idle seconds and an\n"
+        "                              ON_S on / REST_S rest duty cycle (0 = disabled)\n"
+        "  voice2 off|carrier D|detune N\n"
+        "                              own tone on BUZZER_COMP: fixed delay D, or the\n"
+        "                              pattern delay + N (N may be negative, beats)\n"
+        "  hop MS [D0 .. D7]           hop every MS ms (at speed 0), over the range or\n"
+        "                              over the 8 given delay values\n"
+        "  burst N DELAY GAP_MS        pattern 13 plays exactly N cycles at DELAY,\n"
+        "                              then GAP_MS ms of silence\n"
+        "  calibrate                   measure the real frequency of each delay value\n"
+        "                              on the BUZZER-T2 loopback and correct the ranges\n"
+        "\n"
+        "device defaults to $BUZZER_DEV or " DEFAULT_DEVICE ", baud to %d\n",
+        prog, PROTO_BAUD);
+}
+
+int main(int argc, char **argv) {
+    const char *device = getenv("BUZZER_DEV");
+    long baud = PROTO_BAUD;
+    int timeoutMs = DEFAULT_TIMEOUT;
+    int opt, fd, rc = -1;
+    const char *cmd;
+    frame_t f;
+    uint8_t arg;
+
+    if(!device) device = DEFAULT_DEVICE;
+    while((opt = getopt(argc, argv, "+d:b:t:h")) != -1) {
+        switch(opt) {
+            case 'd': device = optarg; break;
+            case 'b': baud = strtol(optarg, NULL, 10); break;
+            case 't': timeoutMs = atoi(optarg); break;
+            default:  usage(argv[0]); return 2;
+        }
+    }
+    if(optind >= argc) {
+        usage(argv[0]);
+        return 2;
+    }
+    cmd = argv[optind++];
+
+    fd = port_open(device, baud);
+    if(fd < 0) return 1;
+
+    if(!strcmp(cmd, "ping")) {
+        rc = transact(fd, PROTO_CMD_PING, NULL, 0, &f, timeoutMs);
+        if(rc == 0) printf("ok\n");
+    } else if(!strcmp(cmd, "status")) {
+        rc = cmd_status(fd, timeoutMs);
+    } else if(!strcmp(cmd, "power") && optind < argc) {
+        if(!strcmp(argv[optind], "on")) arg = 1;
+        else if(!strcmp(argv[optind], "off")) arg = 0;
+        else if(parse_u8(argv[optind], 1, &arg) < 0) goto done;
+        rc = transact(fd, PROTO_CMD_SET_POWER, &arg, 1, &f, timeoutMs);
+    } else if(!strcmp(cmd, "pattern") && optind < argc) {
+        if(parse_u8(argv[optind], PROTO_RESO_PATTERN, &arg) == 0)
+            rc = transact(fd, PROTO_CMD_SET_PATTERN, &arg, 1, &f, timeoutMs);
+    } else if(!strcmp(cmd, "speed") && optind < argc) {
+        if(parse_u8(argv[optind], 4, &arg) == 0)
+            rc = transact(fd, PROTO_CMD_SET_SPEED, &arg, 1, &f, timeoutMs);
+    } else if(!strcmp(cmd, "range") && optind < argc) {
+        if(parse_u8(argv[optind], 1, &arg) == 0)
+            rc = transact(fd, PROTO_CMD_SET_RANGE, &arg, 1, &f, timeoutMs);
+    } else if(!strcmp(cmd, "log") && optind < argc) {
+        int periodMs = optind + 1 < argc ? atoi(argv[optind + 1]) : 100;
+        int seconds = optind + 2 < argc ? atoi(argv[optind + 2]) : 0;
+        rc = cmd_log(fd, argv[optind], periodMs, seconds, timeoutMs);
+    } else if(!strcmp(cmd, "schedule") && optind < argc) {
+        uint8_t sched[6] = { 0 };
+        if(parse_u16(argv[optind], sched) == 0 &&
+           (optind + 1 >= argc || parse_u16(argv[optind + 1], sched + 2) == 0) &&
+           (optind + 2 >= argc || parse_u16(argv[optind + 2], sched + 4) == 0))
+            rc = transact(fd, PROTO_CMD_SET_SCHEDULE, sched, 6, &f, timeoutMs);
+    } else if(!strcmp(cmd, "voice2") && optind < argc) {
+        rc = cmd_voice2(fd, argc - optind, argv + optind, timeoutMs);
+    } else if(!strcmp(cmd, "hop") && optind < argc) {
+        uint8_t hop[1 + PROTO_HOP_SET_SIZE];
+        int n = argc - optind, i;
+        if(n != 1 && n != 1 + PROTO_HOP_SET_SIZE) {
+            fprintf(stderr, "hop takes a period and optionally %d delays\n", PROTO_HOP_SET_SIZE);
+        } else {
+            for(i = 0; i < n; i++) {
+                if(parse_u8(argv[optind + i], 255, &hop[i]) < 0) goto done;
+                if(hop[i] == 0) {
+                    fprintf(stderr, "hop values must be 1-255\n");
+                    goto done;
+                }
+            }
+            rc = transact(fd, PROTO_CMD_SET_HOP, hop, (uint8_t)n, &f, timeoutMs);
+        }
+    } else if(!strcmp(cmd, "burst") && optind + 2 < argc) {
+        uint8_t burst[5];
+        if(parse_u8(argv[optind], 255, &burst[0]) == 0 &&
+           parse_u16(argv[optind + 1], burst + 1) == 0 &&
+           parse_u16(argv[optind + 2], burst + 3) == 0)
+            rc = transact(fd, PROTO_CMD_SET_BURST, burst, 5, &f, timeoutMs);
+    } else if(!strcmp(cmd, "calibrate")) {
+        rc = cmd_calibrate(fd, timeoutMs);
+    } else if(!strcmp(cmd, "upload") && optind < argc) {
+        rc = cmd_upload(fd, argv[optind], timeoutMs);
+    } else {
+        usage(argv[0]);
+    }
+
+done:
+    close(fd);
+    return rc == 0 ? 0 : 1;
+}
@@ -0,0 +1,233 @@
+/**
+ * AT89S52 Buzzer Controller - Pattern Bounds Fuzzer
+ * Boots the firmware in the host model (fwmodel.c) straight into every
+ * pattern and range, as a restart that restores them does, then drives one
+ * instance through every pattern, speed and range, then through random
+ * button presses and setting changes,
+ * checking after every pattern step (1ms) that the delay value stays inside
+ * the limits of the current range, that no scheduler task stays due for more
+ * than TASK_LAG_MS and that the watchdog is fed well inside its timeout. A
+ * failure prints the seed and the last actions, and rerunning with the same
+ * seed repeats it exactly. At the end the unit is switched off and has to
+ * reach POWER-DOWN.
+ *
+ * Patterns 12-14 play absolute delays (uploaded table, burst delay, ping
+ * carrier) and are only checked for a non-zero delay.
+ *
+ * Build: cc -O2 -Wall -DHOST_BUILD -I../code -o fwfuzz fwmodel.c fwfuzz.c
+ */
+
+#define _DEFAULT_SOURCE
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "fwmodel.h"
+#include "protocol.h"
+
+#define BOOT_MS     1000           // Per pattern/range in the boot phase
+#define SWEEP_MS    3000           // Per pattern/speed/range in the sweep phase
+#define TRAIL_SIZE  16             // Actions kept for the failure report
+#define TASK_LAG_MS 5              // Longest a task may stay due
+#define WDT_GAP_MAX (16384 / 2)    // Machine cycles, half the watchdog timeout
+#define DOWN_MS     8000           // Off and untouched until POWER-DOWN, with margin
+
+static uint64_t rng;
+static char trail[TRAIL_SIZE][48];
+static unsigned trailHead;
+static uint64_t stepCount;
+static uint32_t msPerStep;         // Machine cycles per pattern step
+
+static uint32_t rand32(void) {
+    // xorshift64*
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    return (uint32_t)((rng * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static uint32_t rand_below(uint32_t n) {
+    return rand32() % n;
+}
+
+static void note(const char *fmt, ...) {
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(trail[trailHead++ % TRAIL_SIZE], sizeof trail[0], fmt, ap);
+    va_end(ap);
+}
+
+static int absolute_pattern(uint8_t pattern) {
+    return pattern == PROTO_USER_PATTERN || pattern == PROTO_BURST_PATTERN
+           || pattern == PROTO_RANGE_PATTERN;
+}
+
+static void fail(const fw_state_t *s, unsigned long long seed, const char *fmt, ...) {
+    va_list ap;
+    unsigned i;
+
+    fprintf(stderr, "fwfuzz: seed %llu, step %llu: ", seed, (unsigned long long)stepCount);
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fprintf(stderr, "\n  pattern %u speed %u range %u active %u\n", s->pattern, s->speed,
+            s->range, s->active);
+    fprintf(stderr, "  last actions, oldest first:\n");
+    for(i = trailHead > TRAIL_SIZE ? trailHead - TRAIL_SIZE : 0; i < trailHead; i++)
+        fprintf(stderr, "    %s\n", trail[i % TRAIL_SIZE]);
+    exit(1);
+}
+
+// Runs ms pattern steps, checking the delay, the task lag and the watchdog
+// after each
+static void run_checked(uint32_t ms, fw_stats_t *st, unsigned long long seed) {
+    fw_state_t s;
+    int i;
+
+    while(ms--) {
+        fw_run(msPerStep, st);
+        stepCount++;
+        fw_state(&s);
+        if(s.delay == 0
+           || (!absolute_pattern(s.pattern) && (s.delay < s.minDelay || s.delay > s.maxDelay)))
+            fail(&s, seed, "delay %u outside %u-%u", s.delay, s.minDelay, s.maxDelay);
+        for(i = 0; i < FW_MAX_TASKS; i++) {
+            if(st->taskLag[i] > TASK_LAG_MS)
+                fail(&s, seed, "task %d ran %u ms late", i, st->taskLag[i]);
+        }
+        if(st->maxFeedGap > WDT_GAP_MAX)
+            fail(&s, seed, "watchdog unfed for %u cycles", (unsigned)st->maxFeedGap);
+    }
+}
+
+// Press, hold, release; a hold past 600ms is a long press
+static void press(uint8_t id, uint32_t holdMs, fw_stats_t *st, unsigned long long seed) {
+    note("button %d held %d ms", id, (int)holdMs);
+    fw_button(id, 1);
+    run_checked(holdMs, st, seed);
+    fw_button(id, 0);
+}
+
+// Each boot needs a fresh instance, so it runs in a child process. Returns
+// 0 when the boot checked out or the build cannot restart into a pattern.
+static int boot_into(uint8_t pattern, int range, unsigned long long seed) {
+    fw_stats_t st;
+    fw_state_t s;
+    pid_t pid;
+    int status;
+
+    fflush(stdout);
+    pid = fork();
+    if(pid < 0) {
+        perror("fwfuzz: fork");
+        return -1;
+    }
+    if(pid == 0) {
+        note("boot into pattern %d range %d", pattern, range);
+        if(!fw_boot_warm(pattern, 0, range, 1)) _exit(0);
+        fw_state(&s);
+        if(s.pattern != pattern) _exit(0);  // Not in this build, the restart fell back
+        memset(&st, 0, sizeof st);
+        run_checked(BOOT_MS, &st, seed);
+        _exit(0);
+    }
+    if(waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status)) return -1;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    unsigned long long seed = 1, steps = 10000000;
+    fw_stats_t st;
+    fw_state_t s;
+    int p, sp, r, i;
+    unsigned worstLag = 0;
+
+    for(i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-s") && i + 1 < argc) seed = strtoull(argv[++i], NULL, 0);
+        else if(!strcmp(argv[i], "-n") && i + 1 < argc) steps = strtoull(argv[++i], NULL, 0);
+        else {
+            fprintf(stderr, "usage: fwfuzz [-s seed] [-n steps]\n");
+            return 2;
+        }
+    }
+    rng = seed ? seed : 1;
+    msPerStep = (uint32_t)(fw_cycles_per_second() / 1000);
+
+    // A restart that restores a pattern must start it like a pattern change
+    for(p = 0; p < fw_pattern_count(); p++) {
+        for(r = 0; r < 2; r++) {
+            if(boot_into(p, r, seed) < 0) return 1;
+        }
+    }
+
+    memset(&st, 0, sizeof st);
+    fw_boot();
+    fw_set_power(1);
+
+    // Every pattern at every speed in both ranges
+    for(p = 0; p < fw_pattern_count(); p++) {
+        for(sp = 0; sp < fw_speed_count(); sp++) {
+            for(r = 0; r < 2; r++) {
+                note("sweep pattern %d speed %d range %d", p, sp, r);
+                fw_set_range(r);
+                fw_set_speed(sp);
+                fw_set_pattern(p);
+                fw_set_power(1);
+                run_checked(SWEEP_MS, &st, seed);
+            }
+        }
+    }
+
+    // Then random buttons and settings, with the pattern left running between them
+    while(stepCount < steps) {
+        switch(rand_below(8)) {
+            case 0: case 1: case 2:
+                press(rand_below(4), 25 + rand_below(200), &st, seed);
+                break;
+            case 3:
+                press(rand_below(2) ? FW_BTN_PATTERN : FW_BTN_SPEED, 650 + rand_below(400), &st, seed);
+                break;
+            case 4:
+                p = rand_below(fw_pattern_count());
+                note("set pattern %d", p);
+                fw_set_pattern(p);
+                break;
+            case 5:
+                sp = rand_below(fw_speed_count());
+                note("set speed %d", sp);
+                fw_set_speed(sp);
+                break;
+            case 6:
+                r = rand_below(2);
+                note("set range %d", r);
+                fw_set_range(r);
+                break;
+            case 7:
+                note("set power on");
+                fw_set_power(1);
+                break;
+        }
+        run_checked(1 + rand_below(2000), &st, seed);
+    }
+
+    // Nothing may keep an idle unit from powering down
+    note("set power off");
+    fw_set_power(0);
+    run_checked(DOWN_MS, &st, seed);
+    fw_state(&s);
+    if(!s.down) fail(&s, seed, "still running %d ms after power off", DOWN_MS);
+
+    for(i = 0; i < FW_MAX_TASKS; i++) {
+        if(st.taskLag[i] > worstLag) worstLag = st.taskLag[i];
+    }
+    printf("fwfuzz: seed %llu, %llu steps, %llu edges, delay always in range, "
+           "worst task lag %u ms, longest watchdog gap %u cycles\n", seed,
+           (unsigned long long)stepCount, (unsigned long long)st.edges, worstLag,
+           (unsigned)st.maxFeedGap);
+    return 0;
+}
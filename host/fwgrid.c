@@ -0,0 +1,197 @@
+/**
+ * AT89S52 Buzzer Controller - Host Model Grid Runner
+ * Plays every pattern x speed x range configuration in the host model
+ * (fwmodel.c) for a fixed model time and prints one report of tone
+ * frequency, period jitter and CPU budget per configuration.
+ *
+ * The firmware keeps its state in globals, so each configuration runs in a
+ * forked process of its own, as many at once as there are cores, and sends
+ * its result back over a pipe. The crystal is a compile-time profile: build
+ * one binary per FOSC_HZ to compare crystals.
+ *
+ * Build: cc -O2 -Wall -DHOST_BUILD -I../code -o fwgrid fwmodel.c fwgrid.c -lm
+ */
+
+#define _DEFAULT_SOURCE
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fwmodel.h"
+
+typedef struct {
+    uint8_t pattern, speed, range;
+    uint8_t valid;                 // 0 = pattern not available in this build
+    double meanHz, minHz, maxHz;
+    double jitter;                 // Period rms deviation, % of the mean period
+    double taskPct, isrPct, idlePct;
+} result_t;
+
+typedef struct {
+    pid_t pid;
+    int fd;
+    int index;
+} worker_t;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// In the child: one configuration from a fresh boot
+static void run_config(result_t *r, double seconds, uint16_t echo) {
+    fw_stats_t st;
+    fw_state_t s;
+    double cps = fw_cycles_per_second(), mean, var;
+
+    fw_boot();
+    fw_echo(echo);
+    fw_set_range(r->range);
+    fw_set_speed(r->speed);
+    fw_set_pattern(r->pattern);
+    fw_set_power(1);
+    fw_state(&s);
+    r->valid = s.pattern == r->pattern;
+    if(!r->valid) return;
+
+    memset(&st, 0, sizeof st);
+    fw_run((uint64_t)(seconds * cps), &st);
+    if(st.periods) {
+        mean = st.sumPeriod / st.periods;
+        var = st.sumPeriodSq / st.periods - mean * mean;
+        r->meanHz = cps / mean;
+        r->minHz = cps / st.maxPeriod;
+        r->maxHz = cps / st.minPeriod;
+        r->jitter = var > 0 ? 100.0 * sqrt(var) / mean : 0;
+    }
+    r->taskPct = 100.0 * st.taskCycles / st.cycles;
+    r->isrPct = 100.0 * st.isrCycles / st.cycles;
+    r->idlePct = 100.0 * st.idleCycles / st.cycles;
+}
+
+static int spawn(worker_t *w, result_t *r, double seconds, uint16_t echo) {
+    int fds[2];
+
+    if(pipe(fds) < 0) return -1;
+    w->pid = fork();
+    if(w->pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if(w->pid == 0) {
+        close(fds[0]);
+        run_config(r, seconds, echo);
+        // Smaller than PIPE_BUF, so one write that cannot block
+        _exit(write(fds[1], r, sizeof *r) == sizeof *r ? 0 : 1);
+    }
+    close(fds[1]);
+    w->fd = fds[0];
+    return 0;
+}
+
+// Waits for any worker and stores its result, returns the slot it freed
+static int reap(worker_t *w, int n, result_t *results) {
+    pid_t pid;
+    int i, status;
+
+    for(;;) {
+        pid = wait(&status);
+        if(pid < 0) return -1;
+        for(i = 0; i < n; i++) {
+            if(w[i].pid != pid) continue;
+            if(read(w[i].fd, &results[w[i].index], sizeof *results) != sizeof *results
+               || !WIFEXITED(status) || WEXITSTATUS(status)) {
+                fprintf(stderr, "fwgrid: configuration %d failed\n", w[i].index);
+                results[w[i].index].valid = 0;
+            }
+            close(w[i].fd);
+            w[i].pid = 0;
+            return i;
+        }
+    }
+}
+
+static void usage(void) {
+    fprintf(stderr,
+        "usage: fwgrid [-t seconds] [-j jobs] [-e echo_counts] [-c]\n"
+        "  Runs every pattern x speed x range in the host model, -c prints CSV\n");
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    double seconds = 2.0, wall;
+    long echo = 0, jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int csv = 0, n, i, slot, running = 0, worst = -1, shown = 0;
+    result_t *results;
+    worker_t *w;
+
+    for(i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-c")) csv = 1;
+        else if(i + 1 >= argc) usage();
+        else if(!strcmp(argv[i], "-t")) seconds = atof(argv[++i]);
+        else if(!strcmp(argv[i], "-j")) jobs = atol(argv[++i]);
+        else if(!strcmp(argv[i], "-e")) echo = atol(argv[++i]);
+        else usage();
+    }
+    if(seconds <= 0 || jobs < 1 || echo < 0 || echo > 0xFFFF) usage();
+
+    n = fw_pattern_count() * fw_speed_count() * 2;
+    results = calloc(n, sizeof *results);
+    w = calloc(jobs, sizeof *w);
+    if(!results || !w) {
+        fprintf(stderr, "fwgrid: out of memory\n");
+        return 1;
+    }
+    for(i = 0; i < n; i++) {
+        results[i].pattern = i / (fw_speed_count() * 2);
+        results[i].speed = i / 2 % fw_speed_count();
+        results[i].range = i % 2;
+    }
+
+    fflush(stdout);               // Children must not inherit buffered output
+    wall = now_s();
+    for(i = 0; i < n; i++) {
+        if(running < jobs) slot = running++;
+        else slot = reap(w, jobs, results);
+        if(slot >= 0) w[slot].index = i;
+        if(slot < 0 || spawn(&w[slot], &results[i], seconds, (uint16_t)echo) < 0) {
+            perror("fwgrid: fork");
+            return 1;
+        }
+    }
+    while(running--) reap(w, jobs, results);
+    wall = now_s() - wall;
+
+    if(csv) printf("pattern,speed,range,mean_hz,min_hz,max_hz,jitter_pct,task_pct,isr_pct,idle_pct\n");
+    else printf("pat spd rng    mean Hz     min-max Hz   jitter%%  task%%  isr%%  idle%%\n");
+    for(i = 0; i < n; i++) {
+        result_t *r = &results[i];
+        if(!r->valid) continue;
+        shown++;
+        if(r->meanHz && (worst < 0 || r->jitter > results[worst].jitter)) worst = i;
+        if(csv) {
+            printf("%u,%u,%u,%.1f,%.1f,%.1f,%.3f,%.2f,%.2f,%.2f\n", r->pattern, r->speed, r->range,
+                   r->meanHz, r->minHz, r->maxHz, r->jitter, r->taskPct, r->isrPct, r->idlePct);
+        } else {
+            printf("%3u %3u %3u %10.1f %7.0f-%-7.0f %8.2f %6.1f %5.1f %6.1f\n", r->pattern,
+                   r->speed, r->range, r->meanHz, r->minHz, r->maxHz, r->jitter, r->taskPct,
+                   r->isrPct, r->idlePct);
+        }
+    }
+    fprintf(stderr, "fwgrid: %d configurations x %.1f s model time in %.2f s on %ld jobs",
+            shown, seconds, wall, jobs);
+    if(worst >= 0) {
+        fprintf(stderr, ", worst jitter %.2f%% (pattern %u speed %u range %u)",
+                results[worst].jitter, results[worst].pattern, results[worst].speed,
+                results[worst].range);
+    }
+    fprintf(stderr, "\n");
+    return 0;
+}
@@ -0,0 +1,446 @@
+/**
+ * AT89S52 Buzzer Controller - Host Model
+ * Compiles the firmware into this file with HOST_BUILD and steps its main
+ * loop through main_pass(), charging each pass an estimated number of
+ * machine cycles. Timer 0, Timer 2 and the serial port advance by those
+ * cycles and their interrupts run between passes; IDLE skips ahead to the
+ * next Timer 0 overflow or serial interrupt, and POWER-DOWN stops the clock
+ * until BTN_POWER is pressed.
+ *
+ * The cycle costs are estimates of SDCC's output for the loop and tone
+ * paths, not measurements; override the FW_CYCLES_* values with -D after
+ * timing the real build in a simulator. Frequencies are therefore model
+ * frequencies, but changes to the loop show up in them in proportion.
+ *
+ * Build: see fwsim.c
+ */
+
+#include "../code/AT89S52-Buzzer1.c"
+#include "fwmodel.h"
+
+/*----- Cycle Costs -----*/
+#ifndef FW_CYCLES_LOOP
+#define FW_CYCLES_LOOP   14        // Event and tick checks, tone branch
+#endif
+#ifndef FW_CYCLES_TONE8
+#define FW_CYCLES_TONE8  9         // tone_step() and generate_tone8() without a toggle
+#endif
+#ifndef FW_CYCLES_TONE16
+#define FW_CYCLES_TONE16 18        // tone_step() and generate_tone() without a toggle
+#endif
+#ifndef FW_CYCLES_TOGGLE
+#define FW_CYCLES_TOGGLE 12        // Extra for a toggle and the burst count
+#endif
+#ifndef FW_CYCLES_TASK
+#define FW_CYCLES_TASK   200       // One dispatch_events() or scheduler_run() call
+#endif
+#ifndef FW_CYCLES_SCAN
+#define FW_CYCLES_SCAN   70        // scheduler_run() finding nothing due
+#endif
+#ifndef FW_CYCLES_ISR
+#define FW_CYCLES_ISR    45        // Timer 0/2 interrupt, entry to RETI
+#endif
+
+#if NUM_TASKS > FW_MAX_TASKS
+#error "fw_stats_t.taskLag is too small for the scheduler table"
+#endif
+
+/*----- Model State -----*/
+static uint64_t modelClock;        // Machine cycles since fw_boot()
+static uint8_t modelDown;          // In POWER-DOWN, clock stopped
+static uint8_t lastBuzzer;
+static uint16_t echoCounts;
+static uint8_t echoSeen;           // Echo already given since the last ping
+static uint8_t lagTick;            // tickCount when task lag was last checked
+static uint64_t lastFeed;          // modelClock at the last watchdog feed
+#if UART_ENABLE
+// Timer 1 mode 2 with SMOD=1: 16 machine cycles per bit, 10 bits per byte
+#define UART_BYTE_CYCLES (160UL * (256 - T1_RELOAD(PROTO_BAUD)))
+static uint8_t rxQueue[256], txQueue[256];  // Host to RXD, TXD to host
+static uint8_t rxQHead, rxQTail, txQHead, txQTail;
+static uint32_t rxLeft;            // Cycles until the byte on RXD is in, 0 = line idle
+static uint32_t txLeft;            // Cycles until the byte on TXD is out, 0 = idle
+#endif
+
+static void timers_advance(uint32_t cycles, fw_stats_t *st);
+
+static void isr_charge(fw_stats_t *st) {
+    st->isrCycles += FW_CYCLES_ISR;
+    st->cycles += FW_CYCLES_ISR;
+    modelClock += FW_CYCLES_ISR;
+    timers_advance(FW_CYCLES_ISR, st);
+}
+
+static void timer0_advance(uint32_t cycles, fw_stats_t *st) {
+    uint32_t count;
+
+    if(!TR0) return;
+    count = (((uint32_t)TH0 << 8) | TL0) + cycles;
+    TL0 = (uint8_t)count;
+    TH0 = (uint8_t)(count >> 8);
+    if(count > 0xFFFF && ET0 && EA) {
+        Timer0_ISR();
+        isr_charge(st);
+    }
+}
+
+// Timer mode counts cycles and, in capture mode, takes the modelled echo;
+// counter mode is driven from buzzer_sample() through the loopback wire
+static void timer2_advance(uint32_t cycles, fw_stats_t *st) {
+    uint32_t count;
+    uint8_t flagged = 0;
+
+    if(!(T2CON & 0x04) || (T2CON & 0x02)) return;
+    if(!TH2 && !TL2) echoSeen = 0;  // range_ping() cleared it for a new ping
+    count = (((uint32_t)TH2 << 8) | TL2) + cycles;
+    if((T2CON & 0x09) == 0x09 && echoCounts && !echoSeen && count >= echoCounts) {
+        echoSeen = 1;
+        RCAP2L = (uint8_t)echoCounts;
+        RCAP2H = (uint8_t)(echoCounts >> 8);
+        EXF2 = 1;
+        flagged = 1;
+    }
+    TL2 = (uint8_t)count;
+    TH2 = (uint8_t)(count >> 8);
+    if(count > 0xFFFF) {
+        TF2 = 1;
+        flagged = 1;
+    }
+#if RANGING_ENABLE
+    if(flagged && ET2 && EA) {
+        Timer2_ISR();
+        TF2 = EXF2 = 0;           // The firmware clears them by writing T2CON
+        isr_charge(st);
+    }
+#else
+    (void)flagged;
+    (void)st;
+#endif
+}
+
+#if UART_ENABLE
+// Bytes queued by fw_uart_send() arrive back to back; one that completes
+// while RI is still set is lost, as on the chip. A TI interrupt that takes
+// a byte from the ring puts it on TXD for one byte time.
+static void uart_advance(uint32_t cycles, fw_stats_t *st) {
+    uint8_t tail;
+
+    if(rxLeft) {
+        if(cycles < rxLeft) {
+            rxLeft -= cycles;
+        } else {
+            if(!RI) {
+                SBUF = rxQueue[rxQTail];
+                RI = 1;
+            }
+            rxQTail++;
+            rxLeft = rxQTail != rxQHead ? UART_BYTE_CYCLES : 0;
+        }
+    }
+    if(txLeft) {
+        if(cycles < txLeft) {
+            txLeft -= cycles;
+        } else {
+            txLeft = 0;
+            TI = 1;
+        }
+    }
+    if((RI || TI) && ES && EA) {
+        tail = uartTxTail;
+        Serial_ISR();
+        if(uartTxTail != tail) {
+            if((uint8_t)(txQHead + 1) == txQTail) txQTail++;  // Host not reading, keep the newest
+            txQueue[txQHead++] = uartTxBuf[tail];
+            txLeft = UART_BYTE_CYCLES;
+        }
+        isr_charge(st);
+    }
+}
+
+// Cycles until the serial port next interrupts, 0 = not before new input
+static uint32_t uart_next(void) {
+    if(rxLeft && (!txLeft || rxLeft < txLeft)) return rxLeft;
+    return txLeft;
+}
+#endif
+
+static void timers_advance(uint32_t cycles, fw_stats_t *st) {
+    timer0_advance(cycles, st);
+    timer2_advance(cycles, st);
+#if UART_ENABLE
+    uart_advance(cycles, st);
+#endif
+}
+
+// Edge statistics on BUZZER, and the loopback into T2 for calibration
+static void buzzer_sample(fw_stats_t *st) {
+    uint32_t period;
+    uint16_t count;
+
+    if(BUZZER == lastBuzzer) return;
+    lastBuzzer = BUZZER;
+    if(!BUZZER) {
+        if((T2CON & 0x06) == 0x06) {
+            count = (((uint16_t)TH2 << 8) | TL2) + 1;
+            TL2 = (uint8_t)count;
+            TH2 = (uint8_t)(count >> 8);
+        }
+        return;
+    }
+    if(st->edges) {
+        period = (uint32_t)(modelClock - st->lastEdge);
+        if(!st->periods || period < st->minPeriod) st->minPeriod = period;
+        if(period > st->maxPeriod) st->maxPeriod = period;
+        st->sumPeriod += period;
+        st->sumPeriodSq += (double)period * period;
+        st->periods++;
+    }
+    st->edges++;
+    st->lastEdge = modelClock;
+}
+
+// Runs one main_pass() and returns its cost in cycles, worked out from the
+// state it leaves: the events and tasks it found, then the tone path, which
+// runs after them and changes nothing but the gate when a burst ends
+static uint32_t fw_pass(fw_stats_t *st) {
+    uint32_t cost = FW_CYCLES_LOOP;
+    uint8_t before = BUZZER;
+    uint8_t events = evTail != evHead;
+    uint8_t due = schedTick != tickCount;
+    uint8_t tone;
+
+    main_pass();
+    if(events) cost += FW_CYCLES_TASK;
+    if(due) cost += schedTick == tickCount ? FW_CYCLES_SCAN : FW_CYCLES_TASK;
+    st->taskCycles += cost - FW_CYCLES_LOOP;
+
+    tone = BUZZER != before || (isActive && !dutyResting && gateLevel);
+#if CALIBRATE_ENABLE
+    tone |= calActive;            // Calibration forces toneNarrow
+#endif
+    if(tone) cost += toneNarrow ? FW_CYCLES_TONE8 : FW_CYCLES_TONE16;
+    if(BUZZER != before) cost += FW_CYCLES_TOGGLE;
+    return cost;
+}
+
+// Once per tick: how long each enabled task has been due without running
+static void task_lag(fw_stats_t *st) {
+    uint8_t i;
+    int16_t late;
+
+    if(tickCount == lagTick) return;
+    lagTick = tickCount;
+    for(i = 0; i < NUM_TASKS; i++) {
+        if(!taskPeriod[i]) continue;
+        late = (int16_t)((uint16_t)uptimeMs - taskDue[i]);
+        if(late > (int16_t)st->taskLag[i]) st->taskLag[i] = late;
+    }
+}
+
+// The watchdog counts through IDLE but not POWER-DOWN; wdt_feed() leaves
+// 0xE1 in WDTRST, which the model clears to see the next feed
+static void feed_check(fw_stats_t *st) {
+#if WATCHDOG_ENABLE
+    if(WDTRST == 0xE1) {
+        WDTRST = 0;
+        lastFeed = modelClock;
+    } else if(modelClock - lastFeed > st->maxFeedGap) {
+        st->maxFeedGap = (uint32_t)(modelClock - lastFeed);
+    }
+#else
+    (void)st;
+#endif
+}
+
+/*----- Interface -----*/
+void fw_boot() {
+    // Reset values: ports high, buttons released
+    P0 = P1 = P2 = P3 = 0xFF;
+    BTN_POWER = BTN_PATTERN = BTN_SPEED = BTN_RANGE = 1;
+    T2EX = 1;
+#if I2C_ENABLE
+    I2C_SCL = I2C_SDA = 1;        // No devices answer, so every ACK reads as NAK
+#endif
+#if WATCHDOG_ENABLE
+    PCON = warmBlock.magic == WARM_MAGIC ? 0 : 0x10;  // POF unless fw_boot_warm()
+#else
+    PCON = 0x10;                  // POF
+#endif
+    __sdcc_external_startup();
+    system_init();
+    lastBuzzer = BUZZER;
+    lagTick = tickCount;
+    lastFeed = modelClock;
+}
+
+// A watchdog reset that finds these settings in warmBlock, so system_init()
+// starts straight into them. Returns 0 in builds without the watchdog.
+int fw_boot_warm(uint8_t pattern, uint8_t speed, int range, int active) {
+#if WATCHDOG_ENABLE
+    warmBlock.magic = WARM_MAGIC;
+    warmBlock.pattern = pattern;
+    warmBlock.speed = speed;
+    warmBlock.flags = (active ? PROTO_FLAG_ACTIVE : 0) | (range ? PROTO_FLAG_RANGE : 0);
+    warmBlock.crc = warm_crc();
+    fw_boot();
+    return 1;
+#else
+    (void)pattern;
+    (void)speed;
+    (void)range;
+    (void)active;
+    return 0;
+#endif
+}
+
+void fw_run(uint64_t cycles, fw_stats_t *st) {
+    uint64_t end = st->cycles + cycles;
+    uint32_t cost, gap;
+
+    while(st->cycles < end) {
+        if(modelDown) {
+            // Oscillator stopped: time passes, the timers do not
+            st->idleCycles += end - st->cycles;
+            modelClock += end - st->cycles;
+            lastFeed += end - st->cycles;
+            st->cycles = end;
+            break;
+        }
+        cost = fw_pass(st);
+        st->passes++;
+        st->cycles += cost;
+        modelClock += cost;
+        buzzer_sample(st);
+        timers_advance(cost, st);
+        feed_check(st);
+        task_lag(st);
+
+        if(PCON & 0x02) {
+            PCON &= ~0x02;
+            modelDown = 1;
+        } else if(PCON & 0x01) {
+            // IDLE until the Timer 0 overflow, whose ISR counts the idle
+            // tick, or a serial interrupt before it
+            PCON &= ~0x01;
+            if(!TR0) continue;
+            gap = 0x10000 - ((((uint32_t)TH0) << 8) | TL0);
+#if UART_ENABLE
+            if(uart_next() && uart_next() < gap) gap = uart_next();
+#endif
+            st->idleCycles += gap;
+            st->cycles += gap;
+            modelClock += gap;
+            cpuIdle = 1;
+            timers_advance(gap, st);
+            cpuIdle = 0;
+            feed_check(st);
+        }
+    }
+}
+
+// Buttons are active low; POWER and PATTERN interrupt on the falling edge,
+// SPEED and RANGE are polled
+void fw_button(uint8_t id, int pressed) {
+    uint8_t level = !pressed;
+
+    switch(id) {
+        case FW_BTN_POWER:
+            if(pressed && BTN_POWER && EX0 && EA) {
+                BTN_POWER = 0;
+                modelDown = 0;    // Level-triggered INT0 ends POWER-DOWN
+                Ext0_ISR();
+            }
+            BTN_POWER = level;
+            break;
+        case FW_BTN_PATTERN:
+            if(pressed && BTN_PATTERN && EX1 && EA) {
+                BTN_PATTERN = 0;
+                Ext1_ISR();
+            }
+            BTN_PATTERN = level;
+            break;
+        case FW_BTN_SPEED:
+            BTN_SPEED = level;
+            break;
+        case FW_BTN_RANGE:
+            BTN_RANGE = level;
+            break;
+    }
+}
+
+void fw_set_power(int on) {
+    modelDown = 0;
+    set_power(on != 0);
+}
+
+void fw_set_pattern(uint8_t pattern) {
+    if(pattern < NUM_PATTERNS && pattern_valid(pattern)) set_pattern(pattern);
+}
+
+void fw_set_speed(uint8_t speed) {
+    if(speed < NUM_SPEEDS) set_speed(speed);
+}
+
+void fw_set_range(int range) {
+    set_range(range != 0);
+}
+
+void fw_echo(uint16_t counts) {
+    echoCounts = counts;
+}
+
+int fw_uart_send(const uint8_t *data, int len) {
+#if UART_ENABLE
+    int n = 0;
+
+    while(n < len && (uint8_t)(rxQHead + 1) != rxQTail) rxQueue[rxQHead++] = data[n++];
+    if(n && !rxLeft) rxLeft = UART_BYTE_CYCLES;
+    return n;
+#else
+    (void)data;
+    (void)len;
+    return -1;
+#endif
+}
+
+int fw_uart_recv(uint8_t *buf, int max) {
+    int n = 0;
+
+#if UART_ENABLE
+    while(n < max && txQTail != txQHead) buf[n++] = txQueue[txQTail++];
+#else
+    (void)buf;
+    (void)max;
+#endif
+    return n;
+}
+
+void fw_state(fw_state_t *s) {
+    s->active = isActive;
+    s->pattern = currentPattern;
+    s->speed = currentSpeed;
+    s->range = currentRange;
+    s->delay = currentFreqDelay;
+    s->minDelay = rangeParams[currentRange][0];
+    s->maxDelay = rangeParams[currentRange][1];
+    s->gate = gateLevel;
+    s->toneNarrow = toneNarrow;
+#if RANGING_ENABLE
+    s->rangeMm = rangeMm;
+#else
+    s->rangeMm = PROTO_RANGE_NONE;
+#endif
+    s->down = modelDown;
+}
+
+double fw_cycles_per_second() {
+    return FOSC_HZ / 12.0;
+}
+
+int fw_pattern_count() {
+    return NUM_PATTERNS;
+}
+
+int fw_speed_count() {
+    return NUM_SPEEDS;
+}
@@ -0,0 +1,67 @@
+/**
+ * AT89S52 Buzzer Controller - Host Model
+ * Runs the firmware itself (code/AT89S52-Buzzer1.c built with HOST_BUILD,
+ * see code/hal.h) against a cycle-counted model of the main loop, Timer 0,
+ * Timer 2, the serial port and the buttons, and measures what appears on
+ * BUZZER. The serial port needs -DBOARD=BOARD_BRIDGE, as on the target.
+ *
+ * The firmware keeps its state in globals, so there is one instance per
+ * process and only one fw_boot() or fw_boot_warm() call.
+ */
+
+#ifndef FWMODEL_H
+#define FWMODEL_H
+
+#include <stdint.h>
+
+// Button ids, as in the firmware
+#define FW_BTN_POWER   0
+#define FW_BTN_PATTERN 1
+#define FW_BTN_SPEED   2
+#define FW_BTN_RANGE   3
+
+#define FW_MAX_TASKS   8           // Scheduler tasks tracked in fw_stats_t
+
+typedef struct {
+    uint64_t cycles;               // Machine cycles simulated
+    uint64_t passes;               // Main-loop passes
+    uint64_t taskCycles;           // Spent running events and tasks
+    uint64_t isrCycles;            // Spent in Timer 0/2 interrupts
+    uint64_t idleCycles;           // Spent in IDLE or POWER-DOWN
+    uint64_t edges;                // BUZZER rising edges
+    uint64_t lastEdge;             // cycles at the last rising edge
+    uint64_t periods;              // Periods measured between rising edges
+    uint32_t minPeriod, maxPeriod; // In machine cycles
+    double sumPeriod, sumPeriodSq;
+    uint16_t taskLag[FW_MAX_TASKS];  // Worst ms each scheduler task stayed due, by task id
+    uint32_t maxFeedGap;           // Longest run without a watchdog feed, machine cycles
+} fw_stats_t;
+
+typedef struct {
+    uint8_t active, pattern, speed, range;
+    uint16_t delay;                // currentFreqDelay
+    uint16_t minDelay, maxDelay;   // Limits of the current range
+    uint8_t gate;                  // Gate level, 0 = silent
+    uint8_t toneNarrow;            // 8-bit tone path selected
+    uint16_t rangeMm;              // Last echo distance, 0xFFFF = none
+    uint8_t down;                  // In POWER-DOWN
+} fw_state_t;
+
+void fw_boot(void);
+int fw_boot_warm(uint8_t pattern, uint8_t speed, int range, int active);
+void fw_run(uint64_t cycles, fw_stats_t *st);
+void fw_button(uint8_t id, int pressed);
+void fw_set_power(int on);
+void fw_set_pattern(uint8_t pattern);
+void fw_set_speed(uint8_t speed);
+void fw_set_range(int range);
+void fw_echo(uint16_t counts);     // Echo on T2EX this many Timer 2 counts after a ping, 0 = none
+int fw_uart_send(const uint8_t *data, int len);  // Queue bytes for RXD, returns how many fit,
+                                                 // -1 in builds without the serial port
+int fw_uart_recv(uint8_t *buf, int max);         // Bytes sent on TXD so far, returns the count
+void fw_state(fw_state_t *s);
+double fw_cycles_per_second(void);
+int fw_pattern_count(void);
+int fw_speed_count(void);
+
+#endif
@@ -0,0 +1,297 @@
+/**
+ * AT89S52 Buzzer Controller - Serial Protocol Check
+ * Sends frames built from code/protocol.h to the firmware in the host model
+ * (fwmodel.c) through its modelled serial port and checks every reply,
+ * including NAKs for bad frames and arguments, telemetry and a table
+ * upload. Exits non-zero if any reply differs.
+ *
+ * With -p it serves the model on a pseudo-terminal instead, in real time,
+ * so buzzerctl can drive it: prototest.sh runs both.
+ *
+ * Build: cc -O2 -Wall -DHOST_BUILD -DBOARD=BOARD_BRIDGE -I../code -o fwproto fwmodel.c fwproto.c
+ */
+
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fwmodel.h"
+#include "protocol.h"
+
+#define REPLY_MS   200             // Model time allowed for a reply frame
+
+typedef struct {
+    uint8_t cmd;
+    uint8_t len;
+    uint8_t payload[PROTO_MAX_PAYLOAD];
+} frame_t;
+
+static fw_stats_t st;
+static uint32_t cyclesPerMs;
+static int failures;
+
+static uint8_t crc8_update(uint8_t crc, uint8_t b) {
+    uint8_t i;
+
+    crc ^= b;
+    for(i = 0; i < 8; i++) crc = (crc & 0x80) ? (crc << 1) ^ PROTO_CRC_POLY : (crc << 1);
+    return crc;
+}
+
+static uint16_t crc16_update(uint16_t crc, uint8_t b) {
+    uint8_t i;
+
+    crc ^= (uint16_t)b << 8;
+    for(i = 0; i < 8; i++) crc = (crc & 0x8000) ? (crc << 1) ^ PROTO_CRC16_POLY : (crc << 1);
+    return crc;
+}
+
+// Sends one frame; a non-zero crcXor corrupts its checksum
+static void send_frame(uint8_t cmd, const uint8_t *payload, uint8_t len, uint8_t crcXor) {
+    uint8_t buf[PROTO_MAX_PAYLOAD + 4];
+    uint8_t crc = crc8_update(crc8_update(0, cmd), len);
+    int i;
+
+    buf[0] = PROTO_SYNC;
+    buf[1] = cmd;
+    buf[2] = len;
+    for(i = 0; i < len; i++) {
+        buf[3 + i] = payload[i];
+        crc = crc8_update(crc, payload[i]);
+    }
+    buf[3 + len] = crc ^ crcXor;
+    fw_uart_send(buf, len + 4);
+}
+
+// Runs the model until a whole frame has come back on TXD, 0 on timeout.
+// Telemetry frames are skipped unless asked for.
+static int recv_frame(frame_t *f, int wantTelemetry) {
+    static int state = 0, idx;
+    static uint8_t crc;
+    uint8_t c;
+    int ms;
+
+    for(ms = 0; ms < REPLY_MS; ) {
+        if(!fw_uart_recv(&c, 1)) {
+            fw_run(cyclesPerMs, &st);
+            ms++;
+            continue;
+        }
+        switch(state) {
+            case 0:
+                if(c == PROTO_SYNC) state = 1;
+                break;
+            case 1:
+                f->cmd = c;
+                crc = crc8_update(0, c);
+                state = 2;
+                break;
+            case 2:
+                f->len = c;
+                crc = crc8_update(crc, c);
+                idx = 0;
+                state = c > PROTO_MAX_PAYLOAD ? 0 : c ? 3 : 4;
+                break;
+            case 3:
+                f->payload[idx++] = c;
+                crc = crc8_update(crc, c);
+                if(idx >= f->len) state = 4;
+                break;
+            case 4:
+                state = 0;
+                if(c != crc) {
+                    fprintf(stderr, "fwproto: reply 0x%02X with a bad CRC\n", f->cmd);
+                    failures++;
+                } else if(wantTelemetry || f->cmd != PROTO_RSP_TELEMETRY) {
+                    return 1;
+                }
+                break;
+        }
+    }
+    return 0;
+}
+
+static void check(int ok, const char *what) {
+    if(ok) return;
+    fprintf(stderr, "fwproto: FAIL %s\n", what);
+    failures++;
+}
+
+// Sends a command and checks for an ACK, or a NAK with err when err != 0
+static void expect(uint8_t cmd, const uint8_t *arg, uint8_t len, uint8_t err, const char *what) {
+    frame_t f;
+
+    send_frame(cmd, arg, len, 0);
+    if(!recv_frame(&f, 0)) {
+        check(0, what);
+        return;
+    }
+    if(err) check(f.cmd == PROTO_RSP_NAK && f.len == 2 && f.payload[0] == cmd && f.payload[1] == err, what);
+    else check(f.cmd == PROTO_RSP_ACK && f.len == 1 && f.payload[0] == cmd, what);
+}
+
+static void run_checks(void) {
+    static const uint8_t noise[] = {0x00, PROTO_SYNC, 0xFF, PROTO_MAX_PAYLOAD + 1, 0x13, 0x37};
+    static const uint16_t table[PROTO_TABLE_CHUNK][2] = {{30, 40}, {300, 20}, {45, 60}};
+    uint8_t arg[PROTO_MAX_PAYLOAD];
+    uint16_t crc = PROTO_CRC16_INIT;
+    frame_t f;
+    fw_state_t s;
+    int i, n;
+
+    expect(PROTO_CMD_PING, NULL, 0, 0, "ping");
+
+    arg[0] = 1;
+    expect(PROTO_CMD_SET_POWER, arg, 1, 0, "power on");
+    arg[0] = 3;
+    expect(PROTO_CMD_SET_PATTERN, arg, 1, 0, "pattern 3");
+    arg[0] = 2;
+    expect(PROTO_CMD_SET_SPEED, arg, 1, 0, "speed 2");
+    fw_state(&s);
+    check(s.active && s.pattern == 3 && s.speed == 2, "state after power, pattern, speed");
+
+    send_frame(PROTO_CMD_GET_STATUS, NULL, 0, 0);
+    n = recv_frame(&f, 0);
+    check(n && f.cmd == PROTO_RSP_STATUS && f.len == 5 && (f.payload[0] & PROTO_FLAG_ACTIVE)
+          && f.payload[1] == 3 && f.payload[2] == 2, "status");
+
+    // Refused frames and arguments
+    send_frame(PROTO_CMD_PING, NULL, 0, 0x5A);
+    n = recv_frame(&f, 0);
+    check(n && f.cmd == PROTO_RSP_NAK && f.len == 2 && f.payload[1] == PROTO_ERR_CRC, "bad crc");
+    expect(0x7F, NULL, 0, PROTO_ERR_CMD, "unknown command");
+    expect(PROTO_CMD_SET_PATTERN, NULL, 0, PROTO_ERR_LEN, "pattern without argument");
+    arg[0] = 200;
+    expect(PROTO_CMD_SET_PATTERN, arg, 1, PROTO_ERR_ARG, "pattern 200");
+    arg[0] = 9;
+    expect(PROTO_CMD_SET_SPEED, arg, 1, PROTO_ERR_ARG, "speed 9");
+    arg[0] = PROTO_TELEMETRY_MIN_PERIOD - 1;
+    expect(PROTO_CMD_TELEMETRY, arg, 1, PROTO_ERR_ARG, "telemetry below the minimum period");
+    arg[0] = PROTO_USER_PATTERN;
+    expect(PROTO_CMD_SET_PATTERN, arg, 1, PROTO_ERR_STATE, "pattern 12 without a table");
+
+    // Line noise, then the parser must find the next frame
+    fw_uart_send(noise, sizeof noise);
+    expect(PROTO_CMD_PING, NULL, 0, 0, "ping after noise");
+
+    // Telemetry at the minimum period, then off again
+    arg[0] = PROTO_TELEMETRY_MIN_PERIOD;
+    expect(PROTO_CMD_TELEMETRY, arg, 1, 0, "telemetry on");
+    for(i = 0; i < 3; i++) {
+        n = recv_frame(&f, 1);
+        check(n && f.cmd == PROTO_RSP_TELEMETRY && f.len == PROTO_TELEMETRY_LEN
+              && f.payload[2] == 3, "telemetry frame");
+    }
+    arg[0] = 0;
+    expect(PROTO_CMD_TELEMETRY, arg, 1, 0, "telemetry off");
+
+    // Table upload: one TABLE_DATA frame holds PROTO_TABLE_CHUNK points
+    arg[0] = PROTO_TABLE_CHUNK;
+    expect(PROTO_CMD_TABLE_BEGIN, arg, 1, 0, "table begin");
+    arg[0] = 0;
+    for(i = 0; i < PROTO_TABLE_CHUNK; i++) {
+        arg[1 + 4 * i] = table[i][0] >> 8;
+        arg[2 + 4 * i] = table[i][0] & 0xFF;
+        arg[3 + 4 * i] = table[i][1] >> 8;
+        arg[4 + 4 * i] = table[i][1] & 0xFF;
+    }
+    expect(PROTO_CMD_TABLE_DATA, arg, 1 + 4 * PROTO_TABLE_CHUNK, 0, "table data");
+    for(i = 0; i < 4 * PROTO_TABLE_CHUNK; i++) crc = crc16_update(crc, arg[1 + i]);
+    arg[0] = (crc >> 8) ^ 0xFF;
+    arg[1] = crc & 0xFF;
+    expect(PROTO_CMD_TABLE_COMMIT, arg, 2, PROTO_ERR_CRC, "table commit with a wrong crc");
+    arg[0] = crc >> 8;
+    expect(PROTO_CMD_TABLE_COMMIT, arg, 2, 0, "table commit");
+    arg[0] = PROTO_USER_PATTERN;
+    expect(PROTO_CMD_SET_PATTERN, arg, 1, 0, "pattern 12");
+    fw_state(&s);
+    check(s.pattern == PROTO_USER_PATTERN && s.delay == table[0][0], "table plays its first point");
+}
+
+/*----- Pseudo-Terminal Server -----*/
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Moves bytes between the pty and the model, keeping model time at wall time
+static int serve_pty(double seconds) {
+    struct termios tio;
+    struct pollfd pfd;
+    uint8_t buf[64];
+    double start, modelMs = 0;
+    int fd, hold, n;
+
+    fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if(fd < 0 || grantpt(fd) < 0 || unlockpt(fd) < 0) {
+        perror("fwproto: pty");
+        return 1;
+    }
+    if(tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    hold = open(ptsname(fd), O_RDWR | O_NOCTTY);  // No hang-up between clients
+    printf("%s\n", ptsname(fd));
+    fflush(stdout);
+
+    start = now_s();
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    while(seconds <= 0 || modelMs < seconds * 1000) {
+        if(poll(&pfd, 1, 1) > 0 && (pfd.revents & POLLIN)) {
+            n = read(fd, buf, sizeof buf);
+            if(n > 0) fw_uart_send(buf, n);
+        }
+        while(modelMs < (now_s() - start) * 1000) {
+            fw_run(cyclesPerMs, &st);
+            modelMs++;
+        }
+        while((n = fw_uart_recv(buf, sizeof buf)) > 0) {
+            if(write(fd, buf, n) != n) break;
+        }
+    }
+    close(hold);
+    close(fd);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    double seconds = 0;
+    int pty = 0, i;
+
+    for(i = 1; i < argc; i++) {
+        if(!strcmp(argv[i], "-p")) pty = 1;
+        else if(!strcmp(argv[i], "-t") && i + 1 < argc) seconds = atof(argv[++i]);
+        else {
+            fprintf(stderr, "usage: fwproto [-p [-t seconds]]\n"
+                            "  Checks the serial protocol, or with -p serves the model on a pty\n");
+            return 2;
+        }
+    }
+    if(fw_uart_send(NULL, 0) < 0) {
+        fprintf(stderr, "fwproto: no serial port in this build, add -DBOARD=BOARD_BRIDGE\n");
+        return 2;
+    }
+
+    cyclesPerMs = (uint32_t)(fw_cycles_per_second() / 1000);
+    fw_boot();
+    if(pty) return serve_pty(seconds);
+
+    run_checks();
+    if(failures) {
+        fprintf(stderr, "fwproto: %d checks failed\n", failures);
+        return 1;
+    }
+    printf("fwproto: all protocol checks passed\n");
+    return 0;
+}
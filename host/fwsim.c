@@ -0,0 +1,100 @@
+/**
+ * AT89S52 Buzzer Controller - Host Model Runner
+ * Boots the firmware in the host model (fwmodel.c), plays one pattern for a
+ * while and reports the tone on BUZZER, the CPU budget, and how fast the
+ * model itself runs.
+ *
+ * Build: cc -O2 -Wall -DHOST_BUILD -I../code -o fwsim fwmodel.c fwsim.c -lm
+ */
+
+#define _DEFAULT_SOURCE
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fwmodel.h"
+
+static void usage(void) {
+    fprintf(stderr,
+        "usage: fwsim [-p pattern] [-s speed] [-r range] [-t seconds] [-e echo_counts]\n"
+        "  Plays one pattern in the firmware host model and prints its statistics\n");
+    exit(2);
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    int pattern = 0, speed = 0, range = 0, i, worst;
+    double seconds = 1.0, hostTime, cps, mean, sd;
+    long echo = 0;
+    fw_stats_t st;
+    fw_state_t s;
+
+    for(i = 1; i < argc; i++) {
+        if(i + 1 >= argc) usage();
+        if(!strcmp(argv[i], "-p")) pattern = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-s")) speed = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-r")) range = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-t")) seconds = atof(argv[++i]);
+        else if(!strcmp(argv[i], "-e")) echo = atol(argv[++i]);
+        else usage();
+    }
+    if(pattern < 0 || pattern >= fw_pattern_count() || speed < 0 || speed >= fw_speed_count()
+       || range < 0 || range > 1 || seconds <= 0 || echo < 0 || echo > 0xFFFF) {
+        usage();
+    }
+
+    fw_boot();
+    fw_echo((uint16_t)echo);
+    fw_set_range(range);
+    fw_set_speed(speed);
+    fw_set_pattern(pattern);
+    fw_set_power(1);
+    fw_state(&s);
+    if(s.pattern != pattern) {
+        fprintf(stderr, "fwsim: pattern %d is not available\n", pattern);
+        return 1;
+    }
+
+    cps = fw_cycles_per_second();
+    memset(&st, 0, sizeof st);
+    hostTime = now_s();
+    fw_run((uint64_t)(seconds * cps), &st);
+    hostTime = now_s() - hostTime;
+
+    printf("pattern %d speed %d range %d, %.3f s model time\n", pattern, speed, range,
+           st.cycles / cps);
+    if(st.periods) {
+        mean = st.sumPeriod / st.periods;
+        sd = st.sumPeriodSq / st.periods - mean * mean;
+        sd = sd > 0 ? sqrt(sd) : 0;
+        printf("tone:   %.0f Hz mean, %.0f-%.0f Hz, period jitter %.2f cycles rms (%llu edges)\n",
+               cps / mean, cps / st.maxPeriod, cps / st.minPeriod, sd,
+               (unsigned long long)st.edges);
+    } else {
+        printf("tone:   silent\n");
+    }
+    printf("cpu:    %.1f%% tasks, %.1f%% interrupts, %.1f%% idle, %llu loop passes\n",
+           100.0 * st.taskCycles / st.cycles, 100.0 * st.isrCycles / st.cycles,
+           100.0 * st.idleCycles / st.cycles, (unsigned long long)st.passes);
+    worst = 0;
+    for(i = 1; i < FW_MAX_TASKS; i++) {
+        if(st.taskLag[i] > st.taskLag[worst]) worst = i;
+    }
+    printf("tasks:  worst lag %u ms (task %d), watchdog fed at most %.1f ms apart\n",
+           st.taskLag[worst], worst, 1000.0 * st.maxFeedGap / cps);
+    fw_state(&s);
+    printf("state:  delay %u in %u-%u, gate %u, %s tone path\n", s.delay, s.minDelay,
+           s.maxDelay, s.gate, s.toneNarrow ? "8-bit" : "16-bit");
+    if(s.rangeMm != 0xFFFF) printf("range:  %u mm\n", s.rangeMm);
+    printf("host:   %.3f s, %.1f M passes/s, %.1fx real time\n", hostTime,
+           st.passes / hostTime / 1e6, st.cycles / cps / hostTime);
+    return 0;
+}
@@ -0,0 +1,37 @@
+#!/bin/sh
+# Protocol check: builds fwproto and buzzerctl, runs the frame checks against
+# the host model, then serves the model on a pty and drives it with buzzerctl.
+# Run from host/; exits non-zero on the first failure.
+set -e
+cd "$(dirname "$0")"
+
+cc -O2 -Wall -I../code -o buzzerctl buzzerctl.c
+cc -O2 -Wall -DHOST_BUILD -DBOARD=BOARD_BRIDGE -I../code -o fwproto fwmodel.c fwproto.c
+./fwproto
+
+tmp=$(mktemp -d)
+trap 'kill $server 2>/dev/null; rm -rf "$tmp"' EXIT
+./fwproto -p -t 30 > "$tmp/pty" &
+server=$!
+while [ ! -s "$tmp/pty" ]; do sleep 0.1; done
+dev=$(head -n 1 "$tmp/pty")
+
+fail() { echo "prototest: FAIL $*" >&2; exit 1; }
+
+./buzzerctl -d "$dev" ping | grep -q '^ok$' || fail ping
+./buzzerctl -d "$dev" power on > /dev/null || fail "power on"
+./buzzerctl -d "$dev" pattern 3 > /dev/null || fail "pattern 3"
+./buzzerctl -d "$dev" speed 2 > /dev/null || fail "speed 2"
+./buzzerctl -d "$dev" status > "$tmp/status" || fail status
+grep -q '^power: *on' "$tmp/status" && grep -q '^pattern: *3$' "$tmp/status" &&
+    grep -q '^speed: *2$' "$tmp/status" || fail "status after power, pattern, speed"
+
+printf '30 40\n300 20\n45 60\n# comment\n100 5\n' > "$tmp/table"
+./buzzerctl -d "$dev" upload "$tmp/table" | grep -q '^uploaded 4 points' || fail upload
+./buzzerctl -d "$dev" pattern 12 > /dev/null || fail "pattern 12"
+./buzzerctl -d "$dev" status | grep -q '^pattern: *12$' || fail "status after upload"
+
+./buzzerctl -d "$dev" log - 50 1 > "$tmp/log" || fail log
+[ "$(wc -l < "$tmp/log")" -ge 10 ] || fail "log: $(wc -l < "$tmp/log") lines"
+
+echo "prototest: buzzerctl checks passed"
@@ -0,0 +1,85 @@
+/**
+ * AT89S52 Buzzer Controller - Board Profiles
+ * Shared by AT89S52-Buzzer1.c (SDCC) and main.c (Keil C51)
+ *
+ * Build with -DBOARD=BOARD_* for the pin map and -DFOSC_HZ=n for the
+ * crystal (11059200, 12000000, 22118400, 24000000 or 33000000). Every timer
+ * reload and loop-timed delay is derived from these at compile time.
+ */
+
+#ifndef BOARD_H
+#define BOARD_H
+
+/*----- Compiler -----*/
+// BOARD_SBIT declares a port pin in the syntax of the compiler at hand
+#if defined(__SDCC) || defined(SDCC)
+#define BOARD_SBIT(name, port, bit) __sbit __at (port + bit) name
+#elif defined(__C51__)
+#define BOARD_SBIT(name, port, bit) sbit name = port ^ bit
+#elif defined(HOST_BUILD)
+#define BOARD_SBIT(name, port, bit) volatile unsigned char name  // Mock pin, see hal.h
+#else
+#error "Unsupported compiler, use SDCC, Keil C51 or HOST_BUILD"
+#endif
+
+#define BOARD_P1 0x90
+#define BOARD_P3 0xB0
+
+/*----- Boards -----*/
+#define BOARD_BRIDGE 1             // Buzzer bridge on P1.2/P1.3 (main.c wiring), UART free
+#define BOARD_LEGACY 2             // Buzzer bridge on P3.0/P3.1, no serial link
+
+// Each program defaults to the wiring it shipped with: main.c drove
+// P1.2/P1.3, AT89S52-Buzzer1.c (the shipped hex and the Proteus model)
+// P3.0/P3.1
+#ifndef BOARD
+#if defined(__C51__)
+#define BOARD BOARD_BRIDGE
+#else
+#define BOARD BOARD_LEGACY
+#endif
+#endif
+
+#if BOARD == BOARD_BRIDGE
+#define BUZZER_PORT      BOARD_P1
+#define BUZZER_BIT       2
+#define BUZZER_COMP_PORT BOARD_P1
+#define BUZZER_COMP_BIT  3
+#define BOARD_UART       1         // RXD/TXD are free for the serial link
+#elif BOARD == BOARD_LEGACY
+#define BUZZER_PORT      BOARD_P3
+#define BUZZER_BIT       0
+#define BUZZER_COMP_PORT BOARD_P3
+#define BUZZER_COMP_BIT  1
+#define BOARD_UART       0
+#else
+#error "Unknown BOARD"
+#endif
+
+/*----- Crystal -----*/
+#ifndef FOSC_HZ
+#define FOSC_HZ 12000000UL
+#endif
+
+#if FOSC_HZ != 11059200UL && FOSC_HZ != 12000000UL && FOSC_HZ != 22118400UL \
+    && FOSC_HZ != 24000000UL && FOSC_HZ != 33000000UL
+#error "FOSC_HZ is not one of the supported crystals"
+#endif
+
+#define FOSC_KHZ (FOSC_HZ / 1000)
+
+// Timer counts (machine cycles, 12 clocks each) per ms, rounded: 922 at
+// 11.0592MHz, where a tick is 0.04% long. Not usable in #if.
+#define T0_COUNTS_PER_MS ((unsigned int)((FOSC_HZ / 12 + 500) / 1000))
+
+// Timer 1 mode 2 reload for a baud rate with SMOD=1, rounded to the nearest
+// divisor, and the baud rate it actually gives
+#define T1_RELOAD(baud)  (256 - (FOSC_HZ / 192 + (baud) / 2) / (baud))
+#define T1_BAUD(baud)    (FOSC_HZ / 192 / (256 - T1_RELOAD(baud)))
+
+// Loop-timed values are tuned at 12MHz; this scales them to the crystal,
+// rounding up so the shortest delays never drop below their 12MHz value
+// on the 11.0592MHz crystal. Not usable in #if.
+#define FOSC_SCALE(n)    ((unsigned int)(((n) * FOSC_KHZ + 11999) / 12000))
+
+#endif
@@ -0,0 +1,85 @@
+/**
+ * AT89S52 Buzzer Controller - Hardware Abstraction
+ * The firmware reaches the hardware only through SFRs, sbits and the SDCC
+ * storage and interrupt keywords. On the target they come from 8052.h and
+ * the compiler. With HOST_BUILD they become plain variables instead, so
+ * the same source compiles natively and a host program can drive the pins
+ * and timers (host/fwmodel.c).
+ *
+ * The mock is pin-level: every sbit is a variable of its own, separate
+ * from its port or control byte, so a byte write does not reach the bits
+ * and a bit write does not show in the byte. Where the firmware uses both,
+ * the byte side is covered elsewhere: system_init() writes P2 once at
+ * reset value before the LED bits take over, the model reads the TR2 and
+ * flag bits from T2CON and clears TF2/EXF2 itself, and range_sim_echo()
+ * (reads TR2) is a simulator-only path the model replaces with fw_echo().
+ */
+
+#ifndef HAL_H
+#define HAL_H
+
+#ifdef HOST_BUILD
+#include <stdint.h>
+
+#define __sbit volatile uint8_t
+#define __sfr  volatile uint8_t
+#define __bit  uint8_t
+#define __at(addr)
+#define __interrupt(n)
+#define __idata __attribute__((section("idata")))
+#define __xdata __attribute__((section("xdata")))
+#define __code
+#define __asm__(s)
+
+#define main fw_main               // The host program brings its own main()
+
+// The model has no serial port
+#ifndef UART_ENABLE
+#define UART_ENABLE 0
+#endif
+
+/*----- SFRs -----*/
+__sfr P0;
+__sfr P1;
+__sfr P2;
+__sfr P3;
+__sfr PCON;
+__sfr TMOD;
+__sfr TL0;
+__sfr TH0;
+__sfr TL1;
+__sfr TH1;
+__sfr SCON;
+__sfr SBUF;
+__sfr T2CON;
+__sfr RCAP2L;
+__sfr RCAP2H;
+__sfr TL2;
+__sfr TH2;
+
+/*----- Bits -----*/
+__sbit IT0;
+__sbit IE0;
+__sbit IT1;
+__sbit IE1;
+__sbit TR0;
+__sbit TR1;
+__sbit RI;
+__sbit TI;
+__sbit EX0;
+__sbit ET0;
+__sbit EX1;
+__sbit ES;
+__sbit ET2;
+__sbit EA;
+__sbit TF2;
+__sbit EXF2;
+__sbit EXEN2;
+__sbit TR2;
+__sbit T2EX;
+
+#else
+#include <8052.h>
+#endif
+
+#endif